@@ -0,0 +1,442 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "OpenGL.hpp"
+#include "Renderer.hpp"
+#include "Loader.hpp"
+#include "StaticModel.hpp"
+#include "StaticMesh.hpp"
+#include "AnimatedMesh.hpp"
+#include "Animation.hpp"
+#include "Skeleton.hpp"
+#include "Profiler.hpp"
+
+/*
+  Headless benchmark: draws the demo scene along a fixed camera path, once
+  for each renderer mode, with no window. Every frame is finished before the
+  next begins, so a frame's time is everything it cost and its GPU scopes
+  come back by the next frame.
+
+  Writes bench.csv with a row per frame and bench.json with the percentiles
+  of each mode.
+*/
+
+namespace
+{
+  const double FRAME_TIME = 1.0 / 60.0; //Time fed to animation and lights per frame, whatever the real frame took
+
+  struct Mode
+  {
+    const char* name;
+    bool bDepthPrePass;
+    bool bCompactGBuffer;
+    bool bOcclusionCulling;
+    bool bTiledLighting;
+    bool bShadowCache;
+  };
+
+  //The renderer's defaults, then each setting changed on its own so it reads off against "default".
+  //A setting the driver can't support stays off, leaving its mode a repeat of "default".
+  const Mode MODES[] =
+  {
+    {"default", false, false, true, true, true},
+    {"depth-prepass", true, false, true, true, true},
+    {"compact-gbuffer", false, true, true, true, true},
+    {"depth-prepass+compact-gbuffer", true, true, true, true, true},
+    {"no-occlusion-culling", false, false, false, true, true},
+    {"no-tiled-lighting", false, false, true, false, true},
+    {"no-shadow-cache", false, false, true, true, false},
+  };
+
+  //All in milliseconds
+  struct FrameTimes
+  {
+    double cpu; //Building and submitting the frame
+    double frame; //Until the GPU had finished it
+    int drawCalls;
+    int meshesDrawn;
+    //GPU times, filled in a frame later
+    double gpu;
+    double depthPrePass;
+    double geometry;
+    double shadow;
+    double lighting;
+    double composite;
+  };
+
+  struct Scene
+  {
+    ne::StaticModel* sponza;
+    ne::StaticMesh* max;
+    ne::AnimatedMesh* cowboy;
+    ne::Skeleton* cowboySkel;
+    ne::Animation* runAnim;
+    std::vector<glm::mat4> boneInvTransforms;
+  };
+
+  //Camera path, looped through with a Catmull-Rom spline
+  struct CameraKey
+  {
+    glm::vec3 pos;
+    float yaw;
+    float tilt;
+  };
+
+  const CameraKey CAMERA_PATH[] =
+  {
+    {glm::vec3( 10.0f, 7.0f,  0.0f), -1.5f,  0.0f},
+    {glm::vec3(  4.0f, 2.0f,  0.5f), -1.4f,  0.1f},
+    {glm::vec3( -4.0f, 2.0f,  3.0f), -0.8f, -0.1f},
+    {glm::vec3(-11.0f, 3.0f,  0.0f),  0.6f,  0.0f},
+    {glm::vec3( -6.0f, 8.0f, -4.0f),  1.6f,  0.4f},
+    {glm::vec3(  3.0f, 9.0f, -1.0f),  1.9f,  0.3f},
+  };
+  const int NUM_CAMERA_KEYS = sizeof(CAMERA_PATH) / sizeof(CAMERA_PATH[0]);
+
+  template <typename T>
+  T CatmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t)
+  {
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+  }
+
+  //t runs from 0 to 1 once round the whole path
+  CameraKey CameraAt(float t)
+  {
+    const float keyPos = t * NUM_CAMERA_KEYS;
+    const int key = (int)keyPos % NUM_CAMERA_KEYS;
+    const float frac = keyPos - (int)keyPos;
+
+    const CameraKey& k0 = CAMERA_PATH[(key + NUM_CAMERA_KEYS - 1) % NUM_CAMERA_KEYS];
+    const CameraKey& k1 = CAMERA_PATH[key];
+    const CameraKey& k2 = CAMERA_PATH[(key + 1) % NUM_CAMERA_KEYS];
+    const CameraKey& k3 = CAMERA_PATH[(key + 2) % NUM_CAMERA_KEYS];
+
+    CameraKey cam;
+    cam.pos = CatmullRom(k0.pos, k1.pos, k2.pos, k3.pos, frac);
+    cam.yaw = CatmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, frac);
+    cam.tilt = CatmullRom(k0.tilt, k1.tilt, k2.tilt, k3.tilt, frac);
+    return cam;
+  }
+
+  //The same scene main draws, moved along by frame number alone
+  void AddScene(ne::Renderer& renderer, Scene& scene, int frame)
+  {
+    const double time = frame * FRAME_TIME;
+
+    for(size_t i = 0; i < scene.sponza->m_meshes.size(); ++i)
+      renderer.AddStaticMesh(scene.sponza->m_meshes[i], scene.sponza->m_materials[i], glm::mat4(1.0));
+
+    {
+      glm::mat4 rot = glm::rotate(glm::mat4(1), glm::radians(-90.0f), glm::vec3(1,0,0));
+      glm::mat4 pos = glm::translate(glm::mat4(1), glm::vec3(3.0, 0.1, 0.0));
+      glm::mat4 scl = glm::scale(glm::mat4(1), glm::vec3(0.75));
+      renderer.AddStaticMesh(scene.max, nullptr, scl * pos * rot);
+    }
+
+    {
+      glm::mat4 matScale = glm::scale(glm::mat4(1), glm::vec3(0.30f));
+      glm::mat4 matRot = glm::rotate(glm::mat4(1), glm::radians(-90.0f), glm::vec3(1,0,0));
+      const double duration = scene.runAnim->duration();
+      scene.runAnim->apply(scene.cowboySkel, 0.01 + (duration > 0.0 ? fmod(time, duration) : 0.0));
+      scene.cowboySkel->calculateInvTransforms(scene.boneInvTransforms);
+      renderer.AddAnimatedMesh(scene.cowboy, nullptr, matScale * matRot, &scene.boneInvTransforms);
+    }
+
+    renderer.AddPointLight(ne::PointLight(glm::vec3(-5,3,0), glm::vec3(1), 5.0f));
+    renderer.AddPointLight(ne::PointLight(glm::vec3( 5,3,0), glm::vec3(1), 5.0f));
+    renderer.AddPointLight(ne::PointLight(glm::vec3(9 * sin(2*time), 5.5, 5.5 * cos(2*time)), glm::vec3(1), 1.0f));
+    renderer.AddDirectionalLight(ne::DirectionalLight(glm::vec3(1,2,1), glm::vec3(1,1,0.5), 0.5f));
+  }
+
+  //Nearest rank, values must be sorted
+  double Percentile(const std::vector<double>& values, double percent)
+  {
+    if(values.empty())
+      return 0.0;
+
+    size_t rank = (size_t)ceil(percent / 100.0 * values.size());
+    return values[std::min(std::max<size_t>(rank, 1), values.size()) - 1];
+  }
+
+  void WriteSummary(std::ostream& out, const char* name, std::vector<double> values)
+  {
+    std::sort(values.begin(), values.end());
+    double mean = 0.0;
+    for(double value : values)
+      mean += value;
+    if(!values.empty())
+      mean /= values.size();
+
+    out << "\"" << name << "\":{\"mean\":" << mean
+        << ",\"p50\":" << Percentile(values, 50.0)
+        << ",\"p95\":" << Percentile(values, 95.0)
+        << ",\"p99\":" << Percentile(values, 99.0)
+        << ",\"max\":" << (values.empty() ? 0.0 : values.back()) << "}";
+  }
+
+  //A GL context with no surface at all, so no display is needed
+  bool CreateContext(EGLDisplay& display, EGLContext& context)
+  {
+    //Mesa's surfaceless platform first, as the default display wants X or Wayland
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    display = EGL_NO_DISPLAY;
+    if(getPlatformDisplay)
+      display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+    if(display == EGL_NO_DISPLAY)
+      display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+      std::cerr << "Failed to initialise EGL: " << std::hex << eglGetError() << std::dec << std::endl;
+      return false;
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+      std::cerr << "EGL has no desktop OpenGL" << std::endl;
+      return false;
+    }
+
+    const EGLint configAttribs[] =
+    {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if(!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+    {
+      std::cerr << "No EGL config for desktop OpenGL" << std::endl;
+      return false;
+    }
+
+    //No version asked for, so as with SDL the newest compatibility context comes back
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+    if(context == EGL_NO_CONTEXT)
+    {
+      std::cerr << "Failed to create EGL context: " << std::hex << eglGetError() << std::dec << std::endl;
+      return false;
+    }
+
+    if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+      std::cerr << "Failed to make EGL context current without a surface: " << std::hex << eglGetError() << std::dec << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int width = 1920;
+  int height = 1080;
+  int frames = 600;
+  int warmupFrames = 30;
+  std::string outPath = "bench";
+  const char* tracePath = nullptr;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      frames = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+      warmupFrames = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+      width = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+      height = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+      outPath = argv[++i];
+    else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      tracePath = argv[++i];
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--frames N] [--warmup N] [--width W] [--height H] [--out PREFIX] [--trace FILE]" << std::endl;
+      return 1;
+    }
+  }
+
+  if(frames < 1 || width < 1 || height < 1 || warmupFrames < 0)
+  {
+    std::cerr << "Frames and sizes must be positive" << std::endl;
+    return 1;
+  }
+
+  EGLDisplay display;
+  EGLContext context;
+  if(!CreateContext(display, context))
+    return 1;
+
+  std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
+  std::cout << "OpenGL Renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+  //Without a surface there is no default framebuffer, the frame is composited into this instead
+  GLuint outputFBO, outputColor, outputDepth;
+  glGenFramebuffers(1, &outputFBO);
+  glGenRenderbuffers(1, &outputColor);
+  glGenRenderbuffers(1, &outputDepth);
+  glBindRenderbuffer(GL_RENDERBUFFER, outputColor);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, outputDepth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, outputColor);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, outputDepth);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "Output framebuffer incomplete" << std::endl;
+    return 1;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  ne::Renderer* pRenderer = new ne::Renderer();
+  if(!pRenderer->Init(width, height))
+  {
+    std::cerr << "Failed to init renderer." << std::endl;
+    return 1;
+  }
+  pRenderer->SetOutputFramebuffer(outputFBO);
+  pRenderer->SetGlobalIllumination(glm::vec3(0.025));
+
+  ne::Loader loader;
+  Scene scene;
+  scene.sponza = loader.LoadStaticModel("meshes/sponza.obj");
+  scene.max = loader.LoadBakedStaticMesh("max.mesh");
+  scene.cowboy = loader.LoadAnimatedMesh("cowboy.mesh");
+  scene.cowboySkel = loader.LoadSkeleton("cowboy.skel");
+  scene.runAnim = loader.LoadAnimation("cowboy_run.anim");
+  if(!scene.sponza || !scene.max || !scene.cowboy || !scene.cowboySkel || !scene.runAnim)
+  {
+    std::cerr << "Failed to load the scene" << std::endl;
+    return 1;
+  }
+  scene.boneInvTransforms.resize(scene.cowboySkel->bones.size(), glm::mat4(1.0));
+
+  std::ofstream csv(outPath + ".csv");
+  std::ofstream json(outPath + ".json");
+  if(!csv || !json)
+  {
+    std::cerr << "Failed to open " << outPath << ".csv/.json for writing" << std::endl;
+    return 1;
+  }
+
+  csv << std::fixed << std::setprecision(4);
+  csv << "mode,frame,cpu_ms,frame_ms,gpu_ms,depth_prepass_ms,geometry_ms,shadow_ms,lighting_ms,composite_ms,draw_calls,meshes_drawn" << std::endl;
+  json << std::fixed << std::setprecision(4);
+  json << "{\"renderer\":\"" << glGetString(GL_RENDERER) << "\",\"width\":" << width << ",\"height\":" << height
+       << ",\"frames\":" << frames << ",\"modes\":[";
+
+  bool bFirstMode = true;
+  for(const Mode& mode : MODES)
+  {
+    pRenderer->SetDepthPrePass(mode.bDepthPrePass);
+    pRenderer->SetCompactGBuffer(mode.bCompactGBuffer);
+    pRenderer->SetOcclusionCulling(mode.bOcclusionCulling);
+    pRenderer->SetTiledLighting(mode.bTiledLighting);
+    pRenderer->SetShadowCache(mode.bShadowCache);
+
+    //The warm up settles shader compiles and caches, one extra frame brings back the last frame's GPU times
+    std::vector<FrameTimes> times(frames);
+    const int totalFrames = warmupFrames + frames + 1;
+    for(int i = 0; i < totalFrames; ++i)
+    {
+      const int frame = i - warmupFrames; //Timed from 0
+
+      ne::Profiler::Instance().NextFrame();
+      const uint64_t start = ne::Profiler::Now();
+
+      const CameraKey cam = CameraAt(float(i % frames) / frames);
+      pRenderer->SetViewPosition(cam.pos, cam.yaw, cam.tilt);
+      pRenderer->AddTime(FRAME_TIME);
+      pRenderer->BeginFrame();
+      AddScene(*pRenderer, scene, i);
+      pRenderer->EndFrame();
+      const uint64_t submitted = ne::Profiler::Now();
+
+      glFinish();
+      const uint64_t finished = ne::Profiler::Now();
+
+      //Counts belong to this frame, the GPU scopes just collected to the one before
+      const ne::FrameStats stats = pRenderer->LastFrameStats();
+      if(frame >= 0 && frame < frames)
+      {
+        FrameTimes& t = times[frame];
+        t.cpu = double(submitted - start) / 1e6;
+        t.frame = double(finished - start) / 1e6;
+        t.drawCalls = stats.drawCalls;
+        t.meshesDrawn = stats.meshesDrawn;
+      }
+      if(frame >= 1 && frame <= frames)
+      {
+        FrameTimes& t = times[frame - 1];
+        t.gpu = stats.totalTime;
+        t.depthPrePass = stats.depthPrePassTime;
+        t.geometry = stats.geometryTime;
+        t.shadow = stats.shadowTime;
+        t.lighting = stats.lightingTime;
+        t.composite = stats.compositeTime;
+      }
+    }
+
+    std::vector<double> cpu, frame, gpu;
+    for(int i = 0; i < frames; ++i)
+    {
+      const FrameTimes& t = times[i];
+      csv << mode.name << "," << i << "," << t.cpu << "," << t.frame << ","
+          << t.gpu << "," << t.depthPrePass << "," << t.geometry << ","
+          << t.shadow << "," << t.lighting << "," << t.composite << ","
+          << t.drawCalls << "," << t.meshesDrawn << "\n";
+      cpu.push_back(t.cpu);
+      frame.push_back(t.frame);
+      gpu.push_back(t.gpu);
+    }
+
+    json << (bFirstMode ? "\n" : ",\n") << "{\"name\":\"" << mode.name << "\",";
+    WriteSummary(json, "cpu_ms", cpu);
+    json << ",";
+    WriteSummary(json, "frame_ms", frame);
+    json << ",";
+    WriteSummary(json, "gpu_ms", gpu);
+    json << "}";
+    bFirstMode = false;
+
+    std::sort(frame.begin(), frame.end());
+    std::cout << mode.name << ": p50 " << Percentile(frame, 50.0) << "ms, p95 " << Percentile(frame, 95.0)
+              << "ms, p99 " << Percentile(frame, 99.0) << "ms" << std::endl;
+  }
+  json << "\n]}" << std::endl;
+
+  if(tracePath)
+    ne::Profiler::Instance().WriteChromeTrace(tracePath);
+
+  delete pRenderer;
+  glDeleteRenderbuffers(1, &outputColor);
+  glDeleteRenderbuffers(1, &outputDepth);
+  glDeleteFramebuffers(1, &outputFBO);
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+  return (csv && json) ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#version 330 core
+//Either lets the vertex shader pick the layer, so all six faces go in one pass
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
+
+layout (location = 0) in vec3 vertexPos;
+layout (location = 1) in vec3 vertexNorm;
+layout (location = 2) in vec2 vertexUV;
+layout (location = 3) in vec4 boneWeights;
+layout (location = 4) in vec4 boneIds;
+
+uniform mat4 matPos;
+uniform mat4 matLightPos[6];
+uniform int firstLayer; //Of the light's six in the shadow array
+uniform int face; //Drawn once for each face the mesh touches
+
+out vec4 fragPos;
+
+#include "bones.glsl"
+
+void main()
+{
+  vec4 localPos = vec4(0.0);
+
+  for(int i = 0; i < 4; ++i)
+  {
+    vec4 pos = BoneTransform(boneIds[i]) * vec4(vertexPos, 1);
+    localPos += pos * boneWeights[i];
+  }
+
+  fragPos = matPos * localPos;
+  gl_Position = matLightPos[face] * fragPos;
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+  gl_Layer = firstLayer + face;
+#endif
+}
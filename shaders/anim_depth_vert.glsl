@@ -0,0 +1,26 @@
+#version 300 es
+
+layout (location = 0) in vec3 vertexPos;
+layout (location = 3) in vec4 boneWeights;
+layout (location = 4) in vec4 boneIds;
+
+#include "frame.glsl"
+#include "bones.glsl"
+
+uniform mat4 matPos;
+
+//Skinned exactly as animmesh_vert does, so the equal depth test passes
+invariant gl_Position;
+
+void main()
+{
+  vec4 localPos = vec4(0.0);
+
+  for(int i = 0; i < 4; ++i)
+  {
+    vec4 pos = BoneTransform(boneIds[i]) * vec4(vertexPos, 1);
+    localPos += pos * boneWeights[i];
+  }
+
+  gl_Position = matView * matPos * localPos;
+}
@@ -1,7 +1,5 @@
 #version 300 es
 
-const int MAX_BONES = 32;
-
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec3 vertexNorm;
 layout (location = 2) in vec2 vertexUV;
@@ -10,7 +8,8 @@ layout (location = 4) in vec4 boneIds;
 
 uniform mat4 matPos;
 uniform mat4 matLightProj;
-uniform mat4 boneTransforms[MAX_BONES];
+
+#include "bones.glsl"
 
 void main()
 {
@@ -18,7 +17,7 @@ void main()
 
   for(int i = 0; i < 4; ++i)
   {
-    vec4 pos = boneTransforms[int(boneIds[i])] * vec4(vertexPos, 1);
+    vec4 pos = BoneTransform(boneIds[i]) * vec4(vertexPos, 1);
     localPos += pos * boneWeights[i];
   }
 
@@ -2,28 +2,45 @@
 
 precision highp float;
 
-uniform sampler2D sampLambert;
-uniform sampler2D sampNormal;
-uniform sampler2D sampMetallic;
-uniform sampler2D sampRoughness;
+const int MAX_MATERIALS = 1024;
+
+uniform highp sampler2DArray sampLambert;
+uniform highp sampler2DArray sampNormal;
+uniform highp sampler2DArray sampMetallic;
+uniform highp sampler2DArray sampRoughness;
+
+//Layers of the bound arrays holding each material's lambert, normal, metallic and roughness maps
+layout (std140) uniform Materials
+{
+  ivec4 materialLayers[MAX_MATERIALS];
+};
+
+#include "frame.glsl"
+#include "gbuffer.glsl"
 
 in vec2 inUV;
 in mat3 inNormalMat;
+flat in uint inMaterial;
 
-layout (location = 0) out vec3 outLambert;
-layout (location = 1) out vec3 outNormal;
-layout (location = 2) out vec2 outPBRMaps;
+layout (location = 0) out vec4 outLambert;
+layout (location = 1) out vec4 outNormal;
+layout (location = 2) out vec2 outPBRMaps; //Not attached in the compact layout
 
 void main()
 {
-  outLambert = texture(sampLambert, inUV).rgb;
+  vec4 layers = vec4(materialLayers[inMaterial]);
+  vec3 lambert = texture(sampLambert, vec3(inUV, layers.x)).rgb;
+  float metallic = texture(sampMetallic, vec3(inUV, layers.z)).r;
+  float roughness = texture(sampRoughness, vec3(inUV, layers.w)).r;
 
   //Fix the range of the normal from [0,1] to [-1,-1] for calculations
-  vec3 rangeCorrectedNormal = texture(sampNormal, inUV).xyz * 2.0 - 1.0;
+  vec3 rangeCorrectedNormal = texture(sampNormal, vec3(inUV, layers.y)).xyz * 2.0 - 1.0;
   // Textures are flipped, so normals need to be too
   vec3 flippedNormal = vec3(-1, -1, 1) * rangeCorrectedNormal;
   //Transform the normal by the normal of the polygon its attached to
-  outNormal = flippedNormal * inNormalMat;
-  outPBRMaps.r = texture(sampMetallic, inUV).r;
-  outPBRMaps.g = texture(sampRoughness, inUV).r;
+  vec3 normal = flippedNormal * inNormalMat;
+
+  outLambert = vec4(lambert, metallic);
+  outNormal = encodeNormal(normal, roughness);
+  outPBRMaps = vec2(metallic, roughness);
 }
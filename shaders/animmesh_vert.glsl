@@ -1,7 +1,5 @@
 #version 300 es
 
-const int MAX_BONES = 32;
-
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec3 vertexNorm;
 layout (location = 2) in vec2 vertexUV;
@@ -10,24 +8,32 @@ layout (location = 4) in vec4 boneIds;
 
 out vec2 inUV;
 out mat3 inNormalMat;
+flat out uint inMaterial;
+
+#include "frame.glsl"
+#include "bones.glsl"
+
+//Same positions as anim_depth_vert to the bit
+invariant gl_Position;
 
 uniform mat4 matPos;
-uniform mat4 matView;
-uniform mat4 boneTransforms[MAX_BONES];
+uniform uint material;
 
 void main()
 {
   inUV = vertexUV;
+  inMaterial = material;
 
   vec4 localPos = vec4(0.0);
   vec4 localNormal = vec4(0.0);
 
   for(int i = 0; i < 4; ++i)
   {
-    vec4 pos = boneTransforms[int(boneIds[i])] * vec4(vertexPos, 1);
+    mat4 bone = BoneTransform(boneIds[i]);
+    vec4 pos = bone * vec4(vertexPos, 1);
     localPos += pos * boneWeights[i];
 
-    vec4 norm = boneTransforms[int(boneIds[i])] * vec4(vertexNorm, 0);
+    vec4 norm = bone * vec4(vertexNorm, 0);
     localNormal += norm * boneWeights[i];
   }
 
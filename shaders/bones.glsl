@@ -0,0 +1,16 @@
+//Bone matrices of every animated mesh this frame. Each bone takes three
+//texels holding the rows of its affine transform, the last row is implied.
+#define BONES_PER_ROW 512
+
+uniform highp sampler2D sampBones;
+uniform int firstBone; //This mesh's palette within sampBones
+
+mat4 BoneTransform(float boneId)
+{
+  int bone = firstBone + int(boneId);
+  ivec2 texel = ivec2((bone % BONES_PER_ROW) * 3, bone / BONES_PER_ROW);
+  vec4 row0 = texelFetch(sampBones, texel, 0);
+  vec4 row1 = texelFetch(sampBones, texel + ivec2(1, 0), 0);
+  vec4 row2 = texelFetch(sampBones, texel + ivec2(2, 0), 0);
+  return transpose(mat4(row0, row1, row2, vec4(0, 0, 0, 1)));
+}
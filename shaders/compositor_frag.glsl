@@ -5,9 +5,10 @@ precision highp float;
 layout (location = 0) out vec3 outColor;
 
 uniform sampler2D sampBuffer;
-uniform sampler2D sampDepth;
+uniform highp sampler2D sampDepth;
+
+#include "frame.glsl"
 
-uniform vec2 screenSize;
 uniform float gamma;
 uniform float exposure;
 
@@ -1,6 +1,5 @@
-#version 300 es
-
-precision highp float;
+#version 330 core
+//Desktop GLSL like the vertex shaders it links with, which need the layer extensions
 
 in vec4 fragPos;
 
@@ -1,12 +1,24 @@
-#version 300 es
+#version 330 core
+//Either lets the vertex shader pick the layer, so all six faces go in one pass
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
 
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec2 vertexUV;
 layout (location = 2) in vec3 vertexNorm;
+layout (location = 3) in mat4 matPos; //Per instance
+layout (location = 7) in uint face; //Per instance, instances repeat for each face they touch
 
-uniform mat4 matPos;
+uniform mat4 matLightPos[6];
+uniform int firstLayer; //Of the light's six in the shadow array
+
+out vec4 fragPos;
 
 void main()
 {
-  gl_Position = matPos * vec4(vertexPos, 1);
+  fragPos = matPos * vec4(vertexPos, 1);
+  gl_Position = matLightPos[face] * fragPos;
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+  gl_Layer = firstLayer + int(face);
+#endif
 }
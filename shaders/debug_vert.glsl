@@ -2,8 +2,9 @@
 
 layout (location = 0) in vec3 vertexPos;
 
+#include "frame.glsl"
+
 uniform mat4 matPos;
-uniform mat4 matView;
 
 void main()
 {
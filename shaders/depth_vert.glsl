@@ -0,0 +1,14 @@
+#version 300 es
+
+layout (location = 0) in vec3 vertexPos;
+layout (location = 3) in mat4 matPos; //Per instance
+
+#include "frame.glsl"
+
+//The G-buffer pass tests for depth equal to what this writes
+invariant gl_Position;
+
+void main()
+{
+  gl_Position = matView * matPos * vec4(vertexPos, 1);
+}
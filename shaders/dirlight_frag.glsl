@@ -9,16 +9,15 @@ uniform sampler2D sampNormal;
 uniform sampler2D sampPBRMaps;
 uniform sampler2D sampDepth;
 
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-uniform float lightBrightness;
-uniform vec2 screenSize;
+#include "frame.glsl"
+#include "gbuffer.glsl"
+#include "light.glsl"
 
 void main()
 {
   vec2 screenPos = gl_FragCoord.xy / screenSize;
   vec3 lambert = texture(sampLambert, screenPos).rgb;
-  vec3 worldNormal = texture(sampNormal, screenPos).xyz;
+  vec3 worldNormal = decodeNormal(texture(sampNormal, screenPos));
   float depth = texture(sampDepth, screenPos).x;
 
   float cosTheta = max(dot(normalize(lightDir), worldNormal), 0.0);
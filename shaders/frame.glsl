@@ -0,0 +1,12 @@
+//Constants for the whole frame, shared by every program at one binding point
+layout (std140) uniform Frame
+{
+  mat4 matView; //View and projection combined
+  mat4 matInvView;
+  vec3 viewPos;
+  float time;
+  vec2 screenSize;
+  float viewNear;
+  float viewFar;
+  int compactGBuffer; //Which layout gbuffer.glsl reads and writes, and whether light accumulates in R11G11B10F
+};
@@ -0,0 +1,35 @@
+//Encoding of the g buffers, both layouts. Needs frame.glsl for compactGBuffer.
+//Full: lambert, normal as floats, metallic and roughness in a third target.
+//Compact: lambert with metallic in alpha, octahedral normal with roughness in blue.
+
+vec2 octEncode(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e = n.xy;
+  if(n.z < 0.0)
+    e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return e;
+}
+
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
+//What the mesh shaders write to the normal target
+vec4 encodeNormal(vec3 normal, float roughness)
+{
+  if(compactGBuffer != 0)
+    return vec4(octEncode(normal) * 0.5 + 0.5, roughness, 0.0);
+  return vec4(normal, 0.0);
+}
+
+vec3 decodeNormal(vec4 texel)
+{
+  if(compactGBuffer != 0)
+    return octDecode(texel.xy * 2.0 - 1.0);
+  return texel.xyz;
+}
@@ -6,8 +6,9 @@ layout (location = 0) out vec3 outColor;
 
 uniform sampler2D sampColor;
 
+#include "frame.glsl"
+
 uniform vec3 lightColor;
-uniform vec2 screenSize;
 
 void main()
 {
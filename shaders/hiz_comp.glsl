@@ -0,0 +1,45 @@
+#version 310 es
+
+precision highp float;
+
+//One level of the depth pyramid, each texel the farthest depth of the area it covers
+layout (local_size_x = 8, local_size_y = 8) in;
+
+uniform highp sampler2D sampDepth;
+layout (r32f, binding = 0) readonly uniform highp image2D imgSrcLevel;
+layout (r32f, binding = 1) writeonly uniform highp image2D imgDstLevel;
+
+uniform int level;
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 dstSize = imageSize(imgDstLevel);
+  if(any(greaterThanEqual(texel, dstSize)))
+    return;
+
+  float depth = 0.0;
+  if(level == 0)
+  {
+    //The pyramid is rounded down to powers of two, so a texel covers up to 3x3 of the depth buffer
+    ivec2 depthSize = textureSize(sampDepth, 0);
+    ivec2 lo = texel * depthSize / dstSize;
+    ivec2 hi = min(((texel + 1) * depthSize + dstSize - 1) / dstSize, depthSize);
+    for(int y = lo.y; y < hi.y; ++y)
+    {
+      for(int x = lo.x; x < hi.x; ++x)
+        depth = max(depth, texelFetch(sampDepth, ivec2(x, y), 0).x);
+    }
+  }
+  else
+  {
+    //Once one side reaches a single texel it stops halving
+    ivec2 srcMax = imageSize(imgSrcLevel) - 1;
+    ivec2 src = texel * 2;
+    depth = max(
+        max(imageLoad(imgSrcLevel, min(src, srcMax)).x, imageLoad(imgSrcLevel, min(src + ivec2(1, 0), srcMax)).x),
+        max(imageLoad(imgSrcLevel, min(src + ivec2(0, 1), srcMax)).x, imageLoad(imgSrcLevel, min(src + ivec2(1, 1), srcMax)).x));
+  }
+
+  imageStore(imgDstLevel, texel, vec4(depth));
+}
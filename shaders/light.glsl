@@ -0,0 +1,18 @@
+//The light being drawn, a range of one buffer that holds every light this frame
+layout (std140) uniform Light
+{
+  mat4 matPos; //Light volume
+  mat4 matLight; //World to shadow map, spot lights only
+  vec3 lightPos;
+  float lightRadius;
+  vec3 lightDir;
+  float lightBrightness;
+  vec3 lightColor;
+  float innerAngle; //Cosine
+  float outerAngle; //Cosine
+  float nearPlane; //Of the shadow map
+  float farPlane; //Of the shadow map
+  bool useShadows;
+  vec4 shadowRect; //The light's tile of the shadow atlas, or corner of each array layer, offset then size in uv
+  int shadowLayer; //Point light's first of six layers in the shadow array
+};
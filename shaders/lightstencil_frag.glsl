@@ -0,0 +1,8 @@
+#version 300 es
+
+precision highp float;
+
+//Only the stencil buffer is written while marking light volumes
+void main()
+{
+}
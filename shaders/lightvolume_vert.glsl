@@ -0,0 +1,11 @@
+#version 300 es
+
+layout (location = 0) in vec3 vertexPos;
+
+#include "frame.glsl"
+#include "light.glsl"
+
+void main()
+{
+  gl_Position = matView * matPos * vec4(vertexPos, 1);
+}
@@ -3,16 +3,22 @@
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec2 vertexUV;
 layout (location = 2) in vec3 vertexNorm;
+layout (location = 3) in mat4 matPos; //Per instance
+layout (location = 7) in uint material; //Per instance
 
 out vec2 inUV;
 out mat3 inNormalMat;
+flat out uint inMaterial;
 
-uniform mat4 matPos;
-uniform mat4 matView;
+#include "frame.glsl"
+
+//Must match the depth pre-pass exactly for its equal depth test
+invariant gl_Position;
 
 void main()
 {
   inUV = vertexUV;
+  inMaterial = material;
   gl_Position = matView * matPos * vec4(vertexPos, 1);
 
   // Create a matrix for converting from the polygon's tangent
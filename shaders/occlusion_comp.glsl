@@ -0,0 +1,121 @@
+#version 310 es
+
+precision highp float;
+
+//Tests each instance of the static mesh queue against the depth pyramid and
+//copies the visible ones into their draw command's range of instances
+layout (local_size_x = 64) in;
+
+//Same layouts as InstanceData and DrawElementsIndirectCommand in Renderer
+struct Instance
+{
+  mat4 pos;
+  uint material;
+  uint command;
+  uint padding0;
+  uint padding1;
+};
+
+struct Command
+{
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+  Instance instances[];
+};
+
+layout (std430, binding = 1) readonly buffer Spheres
+{
+  vec4 spheres[]; //World space center and radius of each instance
+};
+
+layout (std430, binding = 2) buffer Commands
+{
+  Command commands[]; //Instance counts start at zero
+};
+
+layout (std430, binding = 3) writeonly buffer Visible
+{
+  Instance visible[];
+};
+
+layout (std430, binding = 4) buffer Rejected
+{
+  uint rejected[]; //Instances the first pass hid, for the second to look at again
+};
+
+uniform highp sampler2D sampHiZ;
+uniform mat4 matViewProj; //The one sampHiZ was drawn with
+uniform uint numInstances;
+uniform int phase;
+uniform int hiZLevels; //0 until there is a pyramid, then everything passes
+
+bool isVisible(vec4 sphere)
+{
+  //Screen rectangle around the sphere's box, and the depth of its nearest corner
+  vec2 minUV = vec2(1.0);
+  vec2 maxUV = vec2(0.0);
+  float minDepth = 1.0;
+  for(int i = 0; i < 8; ++i)
+  {
+    vec3 corner = sphere.xyz + sphere.w * vec3(
+        (i & 1) != 0 ? 1.0 : -1.0,
+        (i & 2) != 0 ? 1.0 : -1.0,
+        (i & 4) != 0 ? 1.0 : -1.0);
+    vec4 clip = matViewProj * vec4(corner, 1.0);
+
+    //Reaches behind the eye, too close to tell
+    if(clip.w <= 0.0)
+      return true;
+
+    vec3 ndc = clip.xyz / clip.w;
+    minUV = min(minUV, ndc.xy * 0.5 + 0.5);
+    maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);
+    minDepth = min(minDepth, ndc.z * 0.5 + 0.5);
+  }
+  minUV = clamp(minUV, 0.0, 1.0);
+  maxUV = clamp(maxUV, 0.0, 1.0);
+
+  //The level where the rectangle is at most a texel across, so it touches at most 2x2 of them
+  vec2 size = (maxUV - minUV) * vec2(textureSize(sampHiZ, 0));
+  int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), hiZLevels - 1);
+  ivec2 levelMax = textureSize(sampHiZ, level) - 1;
+  ivec2 lo = min(ivec2(minUV * vec2(levelMax + 1)), levelMax);
+  ivec2 hi = min(ivec2(maxUV * vec2(levelMax + 1)), levelMax);
+
+  float maxDepth = max(
+      max(texelFetch(sampHiZ, lo, level).x, texelFetch(sampHiZ, ivec2(hi.x, lo.y), level).x),
+      max(texelFetch(sampHiZ, ivec2(lo.x, hi.y), level).x, texelFetch(sampHiZ, hi, level).x));
+  return minDepth <= maxDepth;
+}
+
+void main()
+{
+  uint i = gl_GlobalInvocationID.x;
+  if(i >= numInstances)
+    return;
+
+  bool bVisible;
+  if(phase == 0)
+  {
+    bVisible = hiZLevels == 0 || isVisible(spheres[i]);
+    rejected[i] = bVisible ? 0u : 1u;
+  }
+  else
+  {
+    bVisible = rejected[i] != 0u && isVisible(spheres[i]);
+  }
+
+  if(bVisible)
+  {
+    uint command = instances[i].command;
+    uint slot = atomicAdd(commands[command].instanceCount, 1u);
+    visible[commands[command].baseInstance + slot] = instances[i];
+  }
+}
@@ -7,35 +7,61 @@ layout (location = 0) out vec3 outColor;
 uniform sampler2D   sampLambert;
 uniform sampler2D   sampNormal;
 uniform sampler2D   sampPBRMaps;
-uniform sampler2D   sampDepth;
-uniform samplerCube sampShadow;
+uniform highp sampler2D sampDepth;
+uniform highp sampler2DArray sampShadow;
 
-uniform vec3  lightPos;
-uniform vec3  lightColor;
-uniform float lightBrightness;
-uniform vec2  screenSize;
-uniform mat4  matView;
-uniform float farPlane;
+#include "frame.glsl"
+#include "gbuffer.glsl"
+#include "light.glsl"
 
 vec3 calcWorldPos(vec2 screenPos)
 {
  float z = texture(sampDepth, screenPos).x;
  vec4 sPos = vec4(screenPos * 2.0 - 1.0, z * 2.0 - 1.0, 1.0);
- mat4 invMatView = inverse(matView);
- sPos = invMatView * sPos;
+ sPos = matInvView * sPos;
  return sPos.xyz / sPos.w;
 }
 
 float calcAttenuation(vec3 worldPos, vec3 lightPos)
 {
+  //Inverse square, windowed so it reaches zero at the edge of the light volume
   float d = distance(lightPos, worldPos);
-  return 1.0 / (d * d);
+  float window = clamp(1.0 - pow(d / lightRadius, 4.0), 0.0, 1.0);
+  return window * window / (d * d);
+}
+
+//The face a cube map would pick for a direction, as uv then face index
+vec3 cubeFaceCoords(vec3 dir)
+{
+  vec3 a = abs(dir);
+  float ma;
+  vec3 coords;
+  if(a.x >= a.y && a.x >= a.z)
+  {
+    ma = a.x;
+    coords = dir.x > 0.0 ? vec3(-dir.z, -dir.y, 0.0) : vec3(dir.z, -dir.y, 1.0);
+  }
+  else if(a.y >= a.z)
+  {
+    ma = a.y;
+    coords = dir.y > 0.0 ? vec3(dir.x, dir.z, 2.0) : vec3(dir.x, -dir.z, 3.0);
+  }
+  else
+  {
+    ma = a.z;
+    coords = dir.z > 0.0 ? vec3(dir.x, -dir.y, 4.0) : vec3(-dir.x, -dir.y, 5.0);
+  }
+  return vec3(coords.xy / ma * 0.5 + 0.5, coords.z);
 }
 
 float calcShadow(vec3 worldPos, vec3 worldNormal)
 {
   vec3 fragToLight = worldPos - lightPos;
-  float closestDepth = texture(sampShadow, fragToLight).r * farPlane;
+  vec3 face = cubeFaceCoords(fragToLight);
+  //Smaller maps fill the corner of each layer given by shadowRect, stay half a texel inside it
+  vec2 halfTexel = 0.5 / vec2(textureSize(sampShadow, 0).xy);
+  vec2 uv = clamp(shadowRect.xy + face.xy * shadowRect.zw, shadowRect.xy + halfTexel, shadowRect.xy + shadowRect.zw - halfTexel);
+  float closestDepth = texture(sampShadow, vec3(uv, float(shadowLayer) + face.z)).r * farPlane;
   float currentDepth = length(fragToLight);
 
   float bias = max(0.1 * (1.0 - dot(worldNormal, fragToLight)), 0.005);
@@ -46,14 +72,14 @@ void main()
 {
   vec2 screenPos = gl_FragCoord.xy / screenSize;
   vec3 lambert = texture(sampLambert, screenPos).rgb;
-  vec3 worldNormal = texture(sampNormal, screenPos).xyz;
+  vec3 worldNormal = decodeNormal(texture(sampNormal, screenPos));
   vec3 worldPos = calcWorldPos(screenPos);
   float depth = texture(sampDepth, screenPos).x;
 
   vec3 lightDir = normalize(lightPos - worldPos);
   float cosTheta = max(dot(worldNormal, lightDir), 0.0);
   float attenuation = calcAttenuation(worldPos, lightPos);
-  float shadow = calcShadow(worldPos, worldNormal);
+  float shadow = useShadows ? calcShadow(worldPos, worldNormal) : 1.0;
   vec3 radiance = lightBrightness * lightColor * cosTheta * attenuation * shadow;
 
   outColor = vec3(0.0);
@@ -61,5 +87,4 @@ void main()
   {
     outColor = radiance * lambert;
   }
-  gl_FragDepth = depth;
 }
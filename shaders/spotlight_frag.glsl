@@ -7,34 +7,27 @@ layout (location = 0) out vec3 outColor;
 uniform sampler2D sampLambert;
 uniform sampler2D sampNormal;
 uniform sampler2D sampPBRMaps;
-uniform sampler2D sampDepth;
+uniform highp sampler2D sampDepth;
 uniform sampler2D sampShadow;
 
-uniform vec3 lightPos;
-uniform vec3 lightDir;
-uniform float innerAngle;
-uniform float outerAngle;
-uniform vec3 lightColor;
-uniform float lightBrightness;
-uniform vec2 screenSize;
-uniform mat4 matView;
-uniform mat4 matLight;
-uniform float nearPlane;
-uniform float farPlane;
+#include "frame.glsl"
+#include "gbuffer.glsl"
+#include "light.glsl"
 
 vec3 calcWorldPos(vec2 screenPos)
 {
  float z = texture(sampDepth, screenPos).x;
  vec4 sPos = vec4(screenPos * 2.0 - 1.0, z * 2.0 - 1.0, 1.0);
- mat4 invMatView = inverse(matView);
- sPos = invMatView * sPos;
+ sPos = matInvView * sPos;
  return sPos.xyz / sPos.w;
 }
 
 float calcAttenuation(vec3 worldPos, vec3 lightPos)
 {
+  //Inverse square, windowed so it reaches zero at the edge of the light volume
   float d = distance(lightPos, worldPos);
-  return 1.0 / d;
+  float window = clamp(1.0 - pow(d / lightRadius, 4.0), 0.0, 1.0);
+  return window * window / (d * d);
 }
 
 float transformDepth(float depth)
@@ -47,7 +40,13 @@ float calcShadow(vec3 worldPos)
 {
   vec4 lightSpacePos = matLight * vec4(worldPos, 1.0);
   vec3 projCoords = (lightSpacePos.xyz / lightSpacePos.w) * 0.5 + 0.5;
-  float closestDepth = texture(sampShadow, projCoords.xy).r;
+  //Beyond the light's tile is outside its frustum, and another light's map
+  if(any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThan(projCoords.xy, vec2(1.0))))
+    return 0.0;
+  //Kept half a texel inside the tile so nearest filtering never picks a neighbour's texel
+  vec2 halfTexel = 0.5 / vec2(textureSize(sampShadow, 0));
+  vec2 uv = clamp(shadowRect.xy + projCoords.xy * shadowRect.zw, shadowRect.xy + halfTexel, shadowRect.xy + shadowRect.zw - halfTexel);
+  float closestDepth = texture(sampShadow, uv).r;
   float currentDepth = projCoords.z;
   float bias = 0.0001;
   return closestDepth > currentDepth - bias ? 1.0 : 0.0;
@@ -58,20 +57,19 @@ void main()
   outColor = vec3(0.0);
   vec2 screenPos = gl_FragCoord.xy / screenSize;
   float depth = texture(sampDepth, screenPos).x;
-  gl_FragDepth = depth;
   vec3 worldPos = calcWorldPos(screenPos);
 
   if(depth < 1.0)
   {
     vec3 lambert = texture(sampLambert, screenPos).rgb;
-    vec3 worldNormal = texture(sampNormal, screenPos).xyz;
+    vec3 worldNormal = decodeNormal(texture(sampNormal, screenPos));
 
     vec3 fragToLight = normalize(lightPos - worldPos);
     float dirTheta = dot(lightDir, normalize(-fragToLight));
 
     float attenuation = calcAttenuation(worldPos, lightPos);
     float penumbra = smoothstep(outerAngle, innerAngle, dirTheta);
-    float shadow = calcShadow(worldPos);
+    float shadow = useShadows ? calcShadow(worldPos) : 1.0;
 
     float cosTheta = max(dot(worldNormal, fragToLight), 0.0);
     vec3 radiance = lightBrightness * lightColor * cosTheta * attenuation * penumbra * shadow;
@@ -3,8 +3,8 @@
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec2 vertexUV;
 layout (location = 2) in vec3 vertexNorm;
+layout (location = 3) in mat4 matPos; //Per instance
 
-uniform mat4 matPos;
 uniform mat4 matLightProj;
 
 void main()
@@ -0,0 +1,151 @@
+#version 310 es
+
+precision highp float;
+
+#define TILE_SIZE 16
+//Lights past this many in one tile are dropped from it, the binning below clamps to it
+#define MAX_TILE_LIGHTS 256
+
+layout (local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+struct TiledLight
+{
+  vec4 posRadius; //xyz position, w radius
+  vec4 colorBrightness; //rgb color, a brightness
+};
+
+layout (std430, binding = 0) readonly buffer Lights
+{
+  TiledLight lights[];
+};
+
+//Bound to one or the other, ES has no image format for R11G11B10F so it is written as raw bits
+layout (rgba16f, binding = 0) writeonly uniform highp image2D imgComposite;
+layout (r32ui, binding = 1) writeonly uniform highp uimage2D imgPackedComposite;
+
+uniform sampler2D sampLambert;
+uniform sampler2D sampNormal;
+uniform highp sampler2D sampDepth;
+
+#include "frame.glsl"
+#include "gbuffer.glsl"
+
+uniform uint numLights;
+
+shared uint tileMinDepth;
+shared uint tileMaxDepth;
+shared uint tileNumLights;
+shared uint tileLights[MAX_TILE_LIGHTS];
+
+vec3 calcWorldPos(vec2 screenPos, float z)
+{
+ vec4 sPos = vec4(screenPos * 2.0 - 1.0, z * 2.0 - 1.0, 1.0);
+ sPos = matInvView * sPos;
+ return sPos.xyz / sPos.w;
+}
+
+uint packR11G11B10F(vec3 color)
+{
+  //Half floats less their sign and lowest mantissa bits are the small float formats
+  uvec3 h = uvec3(
+      packHalf2x16(vec2(color.r, 0.0)),
+      packHalf2x16(vec2(color.g, 0.0)),
+      packHalf2x16(vec2(color.b, 0.0)));
+  return ((h.r >> 4) & 0x7FFu) | (((h.g >> 4) & 0x7FFu) << 11) | (((h.b >> 5) & 0x3FFu) << 22);
+}
+
+float calcAttenuation(vec3 worldPos, vec3 lightPos, float lightRadius)
+{
+  //Inverse square, windowed so it reaches zero at the edge of the light volume
+  float d = distance(lightPos, worldPos);
+  float window = clamp(1.0 - pow(d / lightRadius, 4.0), 0.0, 1.0);
+  return window * window / (d * d);
+}
+
+void main()
+{
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  bool onScreen = pixel.x < int(screenSize.x) && pixel.y < int(screenSize.y);
+  vec2 screenPos = (vec2(pixel) + 0.5) / screenSize;
+  float depth = onScreen ? texelFetch(sampDepth, pixel, 0).x : 1.0;
+
+  if(gl_LocalInvocationIndex == 0u)
+  {
+    tileMinDepth = floatBitsToUint(1.0);
+    tileMaxDepth = 0u;
+    tileNumLights = 0u;
+  }
+  barrier();
+
+  //Positive floats sort the same as their bit patterns
+  if(depth < 1.0)
+  {
+    atomicMin(tileMinDepth, floatBitsToUint(depth));
+    atomicMax(tileMaxDepth, floatBitsToUint(depth));
+  }
+  barrier();
+
+  float minDepth = uintBitsToFloat(tileMinDepth) * 2.0 - 1.0;
+  float maxDepth = uintBitsToFloat(tileMaxDepth) * 2.0 - 1.0;
+
+  //Planes bounding the tile in world space, from the rows of the view matrix
+  if(tileMaxDepth >= tileMinDepth)
+  {
+    vec2 tileMin = vec2(gl_WorkGroupID.xy * uint(TILE_SIZE)) / screenSize * 2.0 - 1.0;
+    vec2 tileMax = vec2((gl_WorkGroupID.xy + 1u) * uint(TILE_SIZE)) / screenSize * 2.0 - 1.0;
+    mat4 rows = transpose(matView);
+
+    vec4 planes[6];
+    planes[0] = rows[0] - tileMin.x * rows[3];
+    planes[1] = tileMax.x * rows[3] - rows[0];
+    planes[2] = rows[1] - tileMin.y * rows[3];
+    planes[3] = tileMax.y * rows[3] - rows[1];
+    planes[4] = rows[2] - minDepth * rows[3];
+    planes[5] = maxDepth * rows[3] - rows[2];
+    for(int p = 0; p < 6; ++p)
+      planes[p] /= length(planes[p].xyz);
+
+    //Each thread bins a share of the lights
+    for(uint i = gl_LocalInvocationIndex; i < numLights; i += uint(TILE_SIZE * TILE_SIZE))
+    {
+      vec4 posRadius = lights[i].posRadius;
+      bool inside = true;
+      for(int p = 0; p < 6; ++p)
+        inside = inside && dot(planes[p].xyz, posRadius.xyz) + planes[p].w > -posRadius.w;
+
+      if(inside)
+      {
+        uint slot = atomicAdd(tileNumLights, 1u);
+        if(slot < uint(MAX_TILE_LIGHTS))
+          tileLights[slot] = i;
+      }
+    }
+  }
+  barrier();
+
+  if(!onScreen)
+    return;
+
+  vec3 outColor = vec3(0.0);
+  if(depth < 1.0)
+  {
+    vec3 lambert = texelFetch(sampLambert, pixel, 0).rgb;
+    vec3 worldNormal = decodeNormal(texelFetch(sampNormal, pixel, 0));
+    vec3 worldPos = calcWorldPos(screenPos, depth);
+
+    uint count = min(tileNumLights, uint(MAX_TILE_LIGHTS));
+    for(uint i = 0u; i < count; ++i)
+    {
+      TiledLight light = lights[tileLights[i]];
+      vec3 lightDir = normalize(light.posRadius.xyz - worldPos);
+      float cosTheta = max(dot(worldNormal, lightDir), 0.0);
+      float attenuation = calcAttenuation(worldPos, light.posRadius.xyz, light.posRadius.w);
+      outColor += light.colorBrightness.a * light.colorBrightness.rgb * cosTheta * attenuation * lambert;
+    }
+  }
+
+  if(compactGBuffer != 0)
+    imageStore(imgPackedComposite, pixel, uvec4(packR11G11B10F(max(outColor, 0.0))));
+  else
+    imageStore(imgComposite, pixel, vec4(outColor, 1.0));
+}
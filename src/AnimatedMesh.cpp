@@ -1,5 +1,6 @@
 #include "AnimatedMesh.hpp"
 #include "OpenGL.hpp"
+#include "GLState.hpp"
 
 namespace ne
 {
@@ -22,7 +23,7 @@ namespace ne
     if(m_vboIndices)
       glDeleteBuffers(1, &m_vboIndices);
     if(m_vaoConfig)
-      glDeleteVertexArrays(1, &m_vaoConfig);
+      GLState::Current().DeleteVertexArrays(1, &m_vaoConfig);
   }
 
 }
@@ -2,6 +2,7 @@
 
 #include <glm/vec3.hpp>
 #include "OpenGL.hpp"
+#include "Bounds.hpp"
 #include <stdint.h>
 #include <vector>
 
@@ -30,5 +31,6 @@ namespace ne
     uintptr_t m_iOffUV; //The offset to UV data
     uintptr_t m_iOffBoneWeights; //The offset to bone weights
     uintptr_t m_iOffBoneIds; //The offset to bone ids
+    Bounds m_bounds; //Local space bounds of the vertices
   };
 }
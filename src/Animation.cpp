@@ -1,6 +1,7 @@
 #include "Animation.hpp"
 
 #include "Skeleton.hpp"
+#include "Profiler.hpp"
 
 #include <iostream>
 
@@ -16,6 +17,7 @@ namespace ne
 
   void Animation::apply(Skeleton* skeleton, double time)
   {
+    NE_PROFILE_ZONE("Animation::apply");
     for(auto& channel : m_channels)
     {
       //Find the next frame
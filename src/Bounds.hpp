@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+namespace ne
+{
+  //Local space bounding volumes of a mesh
+  struct Bounds
+  {
+    Bounds()
+      : min(0.0f), max(0.0f), center(0.0f), radius(0.0f) {};
+    glm::vec3 min; //Minimum corner of the axis aligned box
+    glm::vec3 max; //Maximum corner of the axis aligned box
+    glm::vec3 center; //Center of the bounding sphere (the box's center)
+    float radius; //Radius of the bounding sphere
+  };
+}
@@ -0,0 +1,240 @@
+#include "CullingBatch.hpp"
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+
+#include <glm/ext.hpp>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+  //Boxes are stored padded to this many entries so the widest batch never reads past the end
+  const size_t BATCH_PADDING = 8;
+}
+
+namespace ne
+{
+
+  CullingBatch::CullingBatch()
+    : m_size(0)
+  {
+  }
+
+  void CullingBatch::Clear()
+  {
+    m_size = 0;
+  }
+
+  void CullingBatch::Reserve(size_t size)
+  {
+    const size_t padded = (size + BATCH_PADDING - 1) / BATCH_PADDING * BATCH_PADDING;
+    if(padded <= m_centerX.size())
+      return;
+
+    m_centerX.resize(padded, 0.0f);
+    m_centerY.resize(padded, 0.0f);
+    m_centerZ.resize(padded, 0.0f);
+    m_extentX.resize(padded, 0.0f);
+    m_extentY.resize(padded, 0.0f);
+    m_extentZ.resize(padded, 0.0f);
+  }
+
+  void CullingBatch::Add(const Bounds& bounds, const glm::mat4& matPos)
+  {
+    Reserve(m_size + 1);
+
+    //Transform the local box into a world space box that encloses it
+    const glm::vec3 localCenter = (bounds.min + bounds.max) * 0.5f;
+    const glm::vec3 localExtent = (bounds.max - bounds.min) * 0.5f;
+    const glm::vec3 center(matPos * glm::vec4(localCenter, 1.0f));
+    const glm::vec3 extent =
+      glm::abs(glm::vec3(matPos[0])) * localExtent.x +
+      glm::abs(glm::vec3(matPos[1])) * localExtent.y +
+      glm::abs(glm::vec3(matPos[2])) * localExtent.z;
+
+    m_centerX[m_size] = center.x;
+    m_centerY[m_size] = center.y;
+    m_centerZ[m_size] = center.z;
+    m_extentX[m_size] = extent.x;
+    m_extentY[m_size] = extent.y;
+    m_extentZ[m_size] = extent.z;
+    ++m_size;
+  }
+
+  glm::vec3 CullingBatch::Center(size_t i) const
+  {
+    return glm::vec3(m_centerX[i], m_centerY[i], m_centerZ[i]);
+  }
+
+  glm::vec3 CullingBatch::Extent(size_t i) const
+  {
+    return glm::vec3(m_extentX[i], m_extentY[i], m_extentZ[i]);
+  }
+
+  void CullingBatch::CullFrustum(const Frustum& frustum, std::vector<uint32_t>& outVisible) const
+  {
+    //A box is outside a plane when dot(n, c) + d < -dot(|n|, e)
+    float nx[frustum_num_planes], ny[frustum_num_planes], nz[frustum_num_planes], nw[frustum_num_planes];
+    float ax[frustum_num_planes], ay[frustum_num_planes], az[frustum_num_planes];
+    for(int p = 0; p < frustum_num_planes; ++p)
+    {
+      nx[p] = frustum.planes[p].x;
+      ny[p] = frustum.planes[p].y;
+      nz[p] = frustum.planes[p].z;
+      nw[p] = frustum.planes[p].w;
+      ax[p] = glm::abs(nx[p]);
+      ay[p] = glm::abs(ny[p]);
+      az[p] = glm::abs(nz[p]);
+    }
+
+#if defined(__AVX__)
+    const size_t width = 8;
+    const __m256 zero = _mm256_setzero_ps();
+    for(size_t i = 0; i < m_size; i += width)
+    {
+      const __m256 cx = _mm256_loadu_ps(&m_centerX[i]);
+      const __m256 cy = _mm256_loadu_ps(&m_centerY[i]);
+      const __m256 cz = _mm256_loadu_ps(&m_centerZ[i]);
+      const __m256 ex = _mm256_loadu_ps(&m_extentX[i]);
+      const __m256 ey = _mm256_loadu_ps(&m_extentY[i]);
+      const __m256 ez = _mm256_loadu_ps(&m_extentZ[i]);
+
+      __m256 outside = zero;
+      for(int p = 0; p < frustum_num_planes; ++p)
+      {
+        __m256 dist = _mm256_mul_ps(cx, _mm256_set1_ps(nx[p]));
+        dist = _mm256_add_ps(dist, _mm256_mul_ps(cy, _mm256_set1_ps(ny[p])));
+        dist = _mm256_add_ps(dist, _mm256_mul_ps(cz, _mm256_set1_ps(nz[p])));
+        dist = _mm256_add_ps(dist, _mm256_set1_ps(nw[p]));
+
+        __m256 radius = _mm256_mul_ps(ex, _mm256_set1_ps(ax[p]));
+        radius = _mm256_add_ps(radius, _mm256_mul_ps(ey, _mm256_set1_ps(ay[p])));
+        radius = _mm256_add_ps(radius, _mm256_mul_ps(ez, _mm256_set1_ps(az[p])));
+
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_LT_OQ));
+      }
+
+      const int visibleMask = ~_mm256_movemask_ps(outside);
+#elif defined(__SSE__)
+    const size_t width = 4;
+    const __m128 zero = _mm_setzero_ps();
+    for(size_t i = 0; i < m_size; i += width)
+    {
+      const __m128 cx = _mm_loadu_ps(&m_centerX[i]);
+      const __m128 cy = _mm_loadu_ps(&m_centerY[i]);
+      const __m128 cz = _mm_loadu_ps(&m_centerZ[i]);
+      const __m128 ex = _mm_loadu_ps(&m_extentX[i]);
+      const __m128 ey = _mm_loadu_ps(&m_extentY[i]);
+      const __m128 ez = _mm_loadu_ps(&m_extentZ[i]);
+
+      __m128 outside = zero;
+      for(int p = 0; p < frustum_num_planes; ++p)
+      {
+        __m128 dist = _mm_mul_ps(cx, _mm_set1_ps(nx[p]));
+        dist = _mm_add_ps(dist, _mm_mul_ps(cy, _mm_set1_ps(ny[p])));
+        dist = _mm_add_ps(dist, _mm_mul_ps(cz, _mm_set1_ps(nz[p])));
+        dist = _mm_add_ps(dist, _mm_set1_ps(nw[p]));
+
+        __m128 radius = _mm_mul_ps(ex, _mm_set1_ps(ax[p]));
+        radius = _mm_add_ps(radius, _mm_mul_ps(ey, _mm_set1_ps(ay[p])));
+        radius = _mm_add_ps(radius, _mm_mul_ps(ez, _mm_set1_ps(az[p])));
+
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+      }
+
+      const int visibleMask = ~_mm_movemask_ps(outside);
+#else
+    const size_t width = 1;
+    for(size_t i = 0; i < m_size; i += width)
+    {
+      int visibleMask = 1;
+      for(int p = 0; p < frustum_num_planes; ++p)
+      {
+        const float dist = m_centerX[i] * nx[p] + m_centerY[i] * ny[p] + m_centerZ[i] * nz[p] + nw[p];
+        const float radius = m_extentX[i] * ax[p] + m_extentY[i] * ay[p] + m_extentZ[i] * az[p];
+        if(dist + radius < 0.0f)
+          visibleMask = 0;
+      }
+#endif
+
+      for(size_t j = 0; j < width && i + j < m_size; ++j)
+      {
+        if(visibleMask & (1 << j))
+          outVisible.push_back(i + j);
+      }
+    }
+  }
+
+  void CullingBatch::CullSphere(const glm::vec3& center, float radius, std::vector<uint32_t>& outVisible) const
+  {
+    //A box touches the sphere when the squared distance from the sphere's
+    //center to the closest point of the box is within radius squared
+    const float radiusSq = radius * radius;
+
+#if defined(__AVX__)
+    const size_t width = 8;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 sx = _mm256_set1_ps(center.x);
+    const __m256 sy = _mm256_set1_ps(center.y);
+    const __m256 sz = _mm256_set1_ps(center.z);
+    for(size_t i = 0; i < m_size; i += width)
+    {
+      __m256 dx = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(&m_centerX[i]), sx));
+      __m256 dy = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(&m_centerY[i]), sy));
+      __m256 dz = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(&m_centerZ[i]), sz));
+      dx = _mm256_max_ps(_mm256_sub_ps(dx, _mm256_loadu_ps(&m_extentX[i])), zero);
+      dy = _mm256_max_ps(_mm256_sub_ps(dy, _mm256_loadu_ps(&m_extentY[i])), zero);
+      dz = _mm256_max_ps(_mm256_sub_ps(dz, _mm256_loadu_ps(&m_extentZ[i])), zero);
+
+      __m256 distSq = _mm256_mul_ps(dx, dx);
+      distSq = _mm256_add_ps(distSq, _mm256_mul_ps(dy, dy));
+      distSq = _mm256_add_ps(distSq, _mm256_mul_ps(dz, dz));
+
+      const int visibleMask = _mm256_movemask_ps(_mm256_cmp_ps(distSq, _mm256_set1_ps(radiusSq), _CMP_LE_OQ));
+#elif defined(__SSE__)
+    const size_t width = 4;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 sx = _mm_set1_ps(center.x);
+    const __m128 sy = _mm_set1_ps(center.y);
+    const __m128 sz = _mm_set1_ps(center.z);
+    for(size_t i = 0; i < m_size; i += width)
+    {
+      __m128 dx = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(&m_centerX[i]), sx));
+      __m128 dy = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(&m_centerY[i]), sy));
+      __m128 dz = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(&m_centerZ[i]), sz));
+      dx = _mm_max_ps(_mm_sub_ps(dx, _mm_loadu_ps(&m_extentX[i])), zero);
+      dy = _mm_max_ps(_mm_sub_ps(dy, _mm_loadu_ps(&m_extentY[i])), zero);
+      dz = _mm_max_ps(_mm_sub_ps(dz, _mm_loadu_ps(&m_extentZ[i])), zero);
+
+      __m128 distSq = _mm_mul_ps(dx, dx);
+      distSq = _mm_add_ps(distSq, _mm_mul_ps(dy, dy));
+      distSq = _mm_add_ps(distSq, _mm_mul_ps(dz, dz));
+
+      const int visibleMask = _mm_movemask_ps(_mm_cmple_ps(distSq, _mm_set1_ps(radiusSq)));
+#else
+    const size_t width = 1;
+    for(size_t i = 0; i < m_size; i += width)
+    {
+      const float dx = std::max(glm::abs(m_centerX[i] - center.x) - m_extentX[i], 0.0f);
+      const float dy = std::max(glm::abs(m_centerY[i] - center.y) - m_extentY[i], 0.0f);
+      const float dz = std::max(glm::abs(m_centerZ[i] - center.z) - m_extentZ[i], 0.0f);
+      const int visibleMask = dx * dx + dy * dy + dz * dz <= radiusSq ? 1 : 0;
+#endif
+
+      for(size_t j = 0; j < width && i + j < m_size; ++j)
+      {
+        if(visibleMask & (1 << j))
+          outVisible.push_back(i + j);
+      }
+    }
+  }
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <stdint.h>
+#include <vector>
+
+namespace ne
+{
+  struct Bounds;
+  class Frustum;
+
+  //World space boxes stored as a structure of arrays so they can be tested
+  //against a frustum or sphere several at a time with SSE/AVX.
+  class CullingBatch
+  {
+  public:
+    CullingBatch();
+
+    void Clear();
+    void Add(const Bounds& bounds, const glm::mat4& matPos);
+    size_t Size() const { return m_size; }
+
+    glm::vec3 Center(size_t i) const;
+    glm::vec3 Extent(size_t i) const;
+
+    //Append the indices of all boxes at least partly inside the frustum
+    void CullFrustum(const Frustum& frustum, std::vector<uint32_t>& outVisible) const;
+    //Append the indices of all boxes touching the sphere
+    void CullSphere(const glm::vec3& center, float radius, std::vector<uint32_t>& outVisible) const;
+
+  private:
+    void Reserve(size_t size);
+
+    size_t m_size;
+    //Padded to a multiple of the widest SIMD batch, padding entries are never visible
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_extentX;
+    std::vector<float> m_extentY;
+    std::vector<float> m_extentZ;
+  };
+}
@@ -0,0 +1,81 @@
+#include "DrawQueue.hpp"
+
+#include <glm/ext.hpp>
+
+namespace
+{
+  const int KEY_DEPTH_BITS = 24;
+  const int KEY_MESH_BITS = 16;
+  const int KEY_MATERIAL_BITS = 16;
+  const int KEY_PROGRAM_BITS = 4;
+
+  const int KEY_MESH_SHIFT = KEY_DEPTH_BITS;
+  const int KEY_MATERIAL_SHIFT = KEY_MESH_SHIFT + KEY_MESH_BITS;
+  const int KEY_PROGRAM_SHIFT = KEY_MATERIAL_SHIFT + KEY_MATERIAL_BITS;
+  const int KEY_PASS_SHIFT = KEY_PROGRAM_SHIFT + KEY_PROGRAM_BITS;
+
+  uint64_t Field(uint32_t value, int bits, int shift)
+  {
+    return uint64_t(value & ((1u << bits) - 1)) << shift;
+  }
+}
+
+namespace ne
+{
+
+  uint64_t DrawQueue::MakeKey(DrawPass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth)
+  {
+    const float maxDepth = float((1u << KEY_DEPTH_BITS) - 1);
+    const uint32_t quantDepth = uint32_t(glm::clamp(depth, 0.0f, 1.0f) * maxDepth);
+
+    return
+      (uint64_t(pass) << KEY_PASS_SHIFT) |
+      Field(program, KEY_PROGRAM_BITS, KEY_PROGRAM_SHIFT) |
+      Field(material, KEY_MATERIAL_BITS, KEY_MATERIAL_SHIFT) |
+      Field(mesh, KEY_MESH_BITS, KEY_MESH_SHIFT) |
+      Field(quantDepth, KEY_DEPTH_BITS, 0);
+  }
+
+  void DrawQueue::Clear()
+  {
+    m_entries.clear();
+  }
+
+  void DrawQueue::Add(uint64_t key, uint32_t index, uint32_t layer)
+  {
+    m_entries.push_back(Entry{key, index, layer});
+  }
+
+  void DrawQueue::Sort()
+  {
+    if(m_entries.size() < 2)
+      return;
+
+    //Least significant byte first, each pass a stable counting sort
+    m_scratch.resize(m_entries.size());
+    for(int shift = 0; shift < 64; shift += 8)
+    {
+      size_t counts[256] = {0};
+      for(const Entry& entry : m_entries)
+        ++counts[(entry.key >> shift) & 0xFF];
+
+      //Every key shares this byte, so the pass would not move anything
+      if(counts[(m_entries[0].key >> shift) & 0xFF] == m_entries.size())
+        continue;
+
+      size_t offset = 0;
+      for(size_t& count : counts)
+      {
+        const size_t start = offset;
+        offset += count;
+        count = start;
+      }
+
+      for(const Entry& entry : m_entries)
+        m_scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+
+      m_entries.swap(m_scratch);
+    }
+  }
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace ne
+{
+  enum DrawPass
+  {
+    draw_pass_geometry,
+    draw_pass_shadow
+  };
+
+  //Draws tagged with a 64 bit sort key and radix sorted so that draws sharing
+  //state end up next to each other. From the top bit down a key holds:
+  //  pass (4) | program (4) | material (16) | mesh (16) | depth (24)
+  class DrawQueue
+  {
+  public:
+    struct Entry
+    {
+      uint64_t key;
+      uint32_t index; //Into whichever instance list the queue was built from
+      uint32_t layer; //Cube face of a point light shadow draw, otherwise 0
+    };
+
+    //Depth is normalised to [0,1] with the nearest draws first
+    static uint64_t MakeKey(DrawPass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth);
+
+    void Clear();
+    void Add(uint64_t key, uint32_t index, uint32_t layer = 0);
+    void Sort();
+
+    size_t Size() const { return m_entries.size(); }
+    const Entry& operator[](size_t i) const { return m_entries[i]; }
+    std::vector<Entry>::const_iterator begin() const { return m_entries.begin(); }
+    std::vector<Entry>::const_iterator end() const { return m_entries.end(); }
+
+  private:
+    std::vector<Entry> m_entries;
+    std::vector<Entry> m_scratch; //Second buffer for the radix sort to scatter into
+  };
+}
@@ -0,0 +1,56 @@
+#include "Frustum.hpp"
+
+#include <glm/ext.hpp>
+
+namespace ne
+{
+
+  Frustum::Frustum()
+  {
+    for(int i = 0; i < frustum_num_planes; ++i)
+      planes[i] = glm::vec4(0.0f);
+  }
+
+  Frustum::Frustum(const glm::mat4& m)
+  {
+    //glm matrices are column major, so m[col][row]
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[frustum_left]   = row3 + row0;
+    planes[frustum_right]  = row3 - row0;
+    planes[frustum_bottom] = row3 + row1;
+    planes[frustum_top]    = row3 - row1;
+    planes[frustum_near]   = row3 + row2;
+    planes[frustum_far]    = row3 - row2;
+
+    //Normalize so plane distances are in world units
+    for(int i = 0; i < frustum_num_planes; ++i)
+      planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+  }
+
+  bool Frustum::TestSphere(const glm::vec3& center, float radius) const
+  {
+    for(int i = 0; i < frustum_num_planes; ++i)
+    {
+      if(glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+        return false;
+    }
+    return true;
+  }
+
+  bool Frustum::TestBox(const glm::vec3& center, const glm::vec3& extent) const
+  {
+    for(int i = 0; i < frustum_num_planes; ++i)
+    {
+      const glm::vec3 normal(planes[i]);
+      const float r = glm::dot(glm::abs(normal), extent);
+      if(glm::dot(normal, center) + planes[i].w < -r)
+        return false;
+    }
+    return true;
+  }
+
+}
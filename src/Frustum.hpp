@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace ne
+{
+  enum FrustumPlane
+  {
+    frustum_left,
+    frustum_right,
+    frustum_bottom,
+    frustum_top,
+    frustum_near,
+    frustum_far,
+    frustum_num_planes
+  };
+
+  class Frustum
+  {
+  public:
+    Frustum();
+    explicit Frustum(const glm::mat4& matViewProj); //Extract the planes of a view projection matrix
+
+    bool TestSphere(const glm::vec3& center, float radius) const;
+    bool TestBox(const glm::vec3& center, const glm::vec3& extent) const;
+
+    //World space planes, normals pointing inwards: dot(xyz, p) + w >= 0 inside
+    glm::vec4 planes[frustum_num_planes];
+  };
+}
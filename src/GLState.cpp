@@ -0,0 +1,233 @@
+#include "GLState.hpp"
+
+namespace ne
+{
+
+  GLState& GLState::Current()
+  {
+    static GLState state;
+    return state;
+  }
+
+  GLState::GLState() :
+    m_program(UNKNOWN),
+    m_vao(UNKNOWN),
+    m_drawFramebuffer(UNKNOWN),
+    m_readFramebuffer(UNKNOWN),
+    m_activeUnit(UNKNOWN),
+    m_depthMask(UNKNOWN),
+    m_depthFunc(UNKNOWN),
+    m_cullFace(UNKNOWN),
+    m_blendSrc(UNKNOWN),
+    m_blendDst(UNKNOWN),
+    m_blendEquation(UNKNOWN),
+    m_colorMask(UNKNOWN),
+    m_polygonMode(UNKNOWN),
+    m_viewport{-1, -1, -1, -1},
+    m_filtered(0)
+  {
+    for(auto& unit : m_textures)
+      for(GLuint& texture : unit)
+        texture = UNKNOWN;
+    for(GLuint& cap : m_caps)
+      cap = UNKNOWN;
+  }
+
+  bool GLState::Change(GLuint& cached, GLuint value)
+  {
+    if(cached == value)
+    {
+      ++m_filtered;
+      return false;
+    }
+    cached = value;
+    return true;
+  }
+
+  void GLState::UseProgram(GLuint program)
+  {
+    if(Change(m_program, program))
+      glUseProgram(program);
+  }
+
+  void GLState::BindVertexArray(GLuint vao)
+  {
+    if(Change(m_vao, vao))
+      glBindVertexArray(vao);
+  }
+
+  void GLState::BindFramebuffer(GLenum target, GLuint framebuffer)
+  {
+    //GL_FRAMEBUFFER binds both, and only goes out if either differs
+    const bool bDraw = target != GL_READ_FRAMEBUFFER && m_drawFramebuffer != framebuffer;
+    const bool bRead = target != GL_DRAW_FRAMEBUFFER && m_readFramebuffer != framebuffer;
+    if(!bDraw && !bRead)
+    {
+      ++m_filtered;
+      return;
+    }
+
+    if(target != GL_READ_FRAMEBUFFER)
+      m_drawFramebuffer = framebuffer;
+    if(target != GL_DRAW_FRAMEBUFFER)
+      m_readFramebuffer = framebuffer;
+    glBindFramebuffer(target, framebuffer);
+  }
+
+  void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture)
+  {
+    const int index = TargetIndex(target);
+    if(unit < MAX_TEXTURE_UNITS && index >= 0 && m_textures[unit][index] == texture)
+    {
+      ++m_filtered;
+      return;
+    }
+
+    if(Change(m_activeUnit, unit))
+      glActiveTexture(GL_TEXTURE0 + unit);
+    if(unit < MAX_TEXTURE_UNITS && index >= 0)
+      m_textures[unit][index] = texture;
+    glBindTexture(target, texture);
+  }
+
+  void GLState::Enable(GLenum cap)
+  {
+    SetCap(cap, true);
+  }
+
+  void GLState::Disable(GLenum cap)
+  {
+    SetCap(cap, false);
+  }
+
+  void GLState::SetCap(GLenum cap, bool bEnabled)
+  {
+    const int index = CapIndex(cap);
+    if(index >= 0 && !Change(m_caps[index], bEnabled))
+      return;
+
+    if(bEnabled)
+      glEnable(cap);
+    else
+      glDisable(cap);
+  }
+
+  void GLState::DepthMask(GLboolean flag)
+  {
+    if(Change(m_depthMask, flag))
+      glDepthMask(flag);
+  }
+
+  void GLState::DepthFunc(GLenum func)
+  {
+    if(Change(m_depthFunc, func))
+      glDepthFunc(func);
+  }
+
+  void GLState::CullFace(GLenum mode)
+  {
+    if(Change(m_cullFace, mode))
+      glCullFace(mode);
+  }
+
+  void GLState::BlendFunc(GLenum src, GLenum dst)
+  {
+    if(m_blendSrc == src && m_blendDst == dst)
+    {
+      ++m_filtered;
+      return;
+    }
+    m_blendSrc = src;
+    m_blendDst = dst;
+    glBlendFunc(src, dst);
+  }
+
+  void GLState::BlendEquation(GLenum mode)
+  {
+    if(Change(m_blendEquation, mode))
+      glBlendEquation(mode);
+  }
+
+  void GLState::ColorMask(GLboolean flag)
+  {
+    if(Change(m_colorMask, flag))
+      glColorMask(flag, flag, flag, flag);
+  }
+
+  void GLState::PolygonMode(GLenum mode)
+  {
+    if(Change(m_polygonMode, mode))
+      glPolygonMode(GL_FRONT_AND_BACK, mode);
+  }
+
+  void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+  {
+    if(m_viewport[0] == x && m_viewport[1] == y && m_viewport[2] == width && m_viewport[3] == height)
+    {
+      ++m_filtered;
+      return;
+    }
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+    glViewport(x, y, width, height);
+  }
+
+  void GLState::DeleteTextures(GLsizei n, const GLuint* textures)
+  {
+    //Deleting a bound texture binds 0 in its place
+    for(GLsizei i = 0; i < n; ++i)
+      for(auto& unit : m_textures)
+        for(GLuint& texture : unit)
+          if(texture == textures[i])
+            texture = 0;
+    glDeleteTextures(n, textures);
+  }
+
+  void GLState::DeleteVertexArrays(GLsizei n, const GLuint* arrays)
+  {
+    for(GLsizei i = 0; i < n; ++i)
+      if(m_vao == arrays[i])
+        m_vao = 0;
+    glDeleteVertexArrays(n, arrays);
+  }
+
+  void GLState::DeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+  {
+    for(GLsizei i = 0; i < n; ++i)
+    {
+      if(m_drawFramebuffer == framebuffers[i])
+        m_drawFramebuffer = 0;
+      if(m_readFramebuffer == framebuffers[i])
+        m_readFramebuffer = 0;
+    }
+    glDeleteFramebuffers(n, framebuffers);
+  }
+
+  int GLState::TargetIndex(GLenum target)
+  {
+    switch(target)
+    {
+      case GL_TEXTURE_2D: return target_2d;
+      case GL_TEXTURE_2D_ARRAY: return target_2d_array;
+      case GL_TEXTURE_CUBE_MAP: return target_cube_map;
+      default: return -1;
+    }
+  }
+
+  int GLState::CapIndex(GLenum cap)
+  {
+    switch(cap)
+    {
+      case GL_BLEND: return cap_blend;
+      case GL_CULL_FACE: return cap_cull_face;
+      case GL_DEPTH_TEST: return cap_depth_test;
+      case GL_STENCIL_TEST: return cap_stencil_test;
+      case GL_SCISSOR_TEST: return cap_scissor_test;
+      case GL_DEPTH_CLAMP: return cap_depth_clamp;
+      default: return -1;
+    }
+  }
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include <stddef.h>
+
+namespace ne
+{
+  //Mirror of the context's bindings and fixed function state. Calls that
+  //would leave GL as it already is are dropped before they reach the driver
+  //and counted. Everything drawing with the context goes through here so the
+  //mirror stays true, including deletes, which GL treats as unbinding.
+  class GLState
+  {
+  public:
+    static GLState& Current(); //The state of the one context we draw with
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vao);
+    void BindFramebuffer(GLenum target, GLuint framebuffer);
+    //Selects the unit as well, so callers never set the active texture themselves
+    void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    void Enable(GLenum cap);
+    void Disable(GLenum cap);
+    void DepthMask(GLboolean flag);
+    void DepthFunc(GLenum func);
+    void CullFace(GLenum mode);
+    void BlendFunc(GLenum src, GLenum dst);
+    void BlendEquation(GLenum mode);
+    void ColorMask(GLboolean flag); //All four channels together
+    void PolygonMode(GLenum mode); //Front and back together
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void DeleteTextures(GLsizei n, const GLuint* textures);
+    void DeleteVertexArrays(GLsizei n, const GLuint* arrays);
+    void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+
+    size_t Filtered() const { return m_filtered; } //Calls dropped since the context was made
+
+    static const GLuint MAX_TEXTURE_UNITS = 16;
+
+  private:
+    //Texture targets tracked per unit, others pass straight through
+    enum
+    {
+      target_2d,
+      target_2d_array,
+      target_cube_map,
+      num_targets
+    };
+
+    //Capabilities tracked by Enable and Disable, others pass straight through
+    enum
+    {
+      cap_blend,
+      cap_cull_face,
+      cap_depth_test,
+      cap_stencil_test,
+      cap_scissor_test,
+      cap_depth_clamp,
+      num_caps
+    };
+
+    GLState();
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    //Record a new value, false if it was already set
+    bool Change(GLuint& cached, GLuint value);
+    void SetCap(GLenum cap, bool bEnabled);
+    static int TargetIndex(GLenum target);
+    static int CapIndex(GLenum cap);
+
+    //Values are UNKNOWN until first set, so whatever GL starts with is never assumed
+    static const GLuint UNKNOWN = ~0u;
+
+    GLuint m_program;
+    GLuint m_vao;
+    GLuint m_drawFramebuffer;
+    GLuint m_readFramebuffer;
+    GLuint m_activeUnit;
+    GLuint m_textures[MAX_TEXTURE_UNITS][num_targets];
+    GLuint m_caps[num_caps];
+    GLuint m_depthMask;
+    GLuint m_depthFunc;
+    GLuint m_cullFace;
+    GLuint m_blendSrc;
+    GLuint m_blendDst;
+    GLuint m_blendEquation;
+    GLuint m_colorMask;
+    GLuint m_polygonMode;
+    GLint m_viewport[4];
+    size_t m_filtered;
+  };
+}
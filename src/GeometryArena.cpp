@@ -0,0 +1,124 @@
+#include "GeometryArena.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+
+namespace
+{
+  //Enough for a few props before the first resize
+  const size_t INITIAL_VERTEX_BYTES = 1 << 20;
+  const size_t INITIAL_INDEX_BYTES = 1 << 18;
+}
+
+namespace ne
+{
+
+  GeometryArena& GeometryArena::Static()
+  {
+    static GeometryArena arena;
+    return arena;
+  }
+
+  GeometryArena::GeometryArena() :
+    m_vaoConfig(0),
+    m_vboVertices(0),
+    m_vboIndices(0),
+    m_vertexCapacity(0),
+    m_vertexSize(0),
+    m_indexCapacity(0),
+    m_indexSize(0),
+    m_numAllocations(0)
+  {
+  }
+
+  void GeometryArena::Allocate(const GLfloat* vertices, size_t numVerts, const GLuint* indices, size_t numIndices,
+      GLint& outBaseVertex, GLuint& outFirstIndex)
+  {
+    const size_t stride = FLOATS_PER_VERTEX * sizeof(GLfloat);
+    const size_t vertexBytes = numVerts * stride;
+    const size_t indexBytes = numIndices * sizeof(GLuint);
+
+    if(!m_vaoConfig)
+      glGenVertexArrays(1, &m_vaoConfig);
+
+    const GLuint oldVertices = m_vboVertices;
+    const GLuint oldIndices = m_vboIndices;
+    Reserve(m_vboVertices, m_vertexCapacity, m_vertexSize, m_vertexSize + vertexBytes, INITIAL_VERTEX_BYTES);
+    Reserve(m_vboIndices, m_indexCapacity, m_indexSize, m_indexSize + indexBytes, INITIAL_INDEX_BYTES);
+
+    //The copy targets leave whatever vertex array is bound untouched
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_vboVertices);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, m_vertexSize, vertexBytes, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_vboIndices);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, m_indexSize, indexBytes, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    //Point the vertex array at the new buffers if they moved
+    if(m_vboVertices != oldVertices || m_vboIndices != oldIndices)
+    {
+      GLState::Current().BindVertexArray(m_vaoConfig);
+
+      glBindBuffer(GL_ARRAY_BUFFER, m_vboVertices);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vboIndices);
+
+      glEnableVertexAttribArray(0);
+      glEnableVertexAttribArray(1);
+      glEnableVertexAttribArray(2);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(0 * sizeof(GLfloat)));
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+      glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(GLfloat)));
+
+      GLState::Current().BindVertexArray(0);
+    }
+
+    outBaseVertex = m_vertexSize / stride;
+    outFirstIndex = m_indexSize / sizeof(GLuint);
+    m_vertexSize += vertexBytes;
+    m_indexSize += indexBytes;
+    ++m_numAllocations;
+  }
+
+  void GeometryArena::Release()
+  {
+    if(m_numAllocations == 0 || --m_numAllocations > 0)
+      return;
+
+    glDeleteBuffers(1, &m_vboVertices);
+    glDeleteBuffers(1, &m_vboIndices);
+    GLState::Current().DeleteVertexArrays(1, &m_vaoConfig);
+    m_vboVertices = 0;
+    m_vboIndices = 0;
+    m_vaoConfig = 0;
+    m_vertexCapacity = 0;
+    m_vertexSize = 0;
+    m_indexCapacity = 0;
+    m_indexSize = 0;
+  }
+
+  void GeometryArena::Reserve(GLuint& buffer, size_t& capacity, size_t used, size_t needed, size_t initial)
+  {
+    if(buffer && needed <= capacity)
+      return;
+
+    //Double so that loading many meshes only copies a logarithmic number of times
+    const size_t newCapacity = std::max(needed, std::max(capacity * 2, initial));
+
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+
+    if(buffer)
+    {
+      glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glDeleteBuffers(1, &buffer);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    buffer = newBuffer;
+    capacity = newCapacity;
+  }
+
+}
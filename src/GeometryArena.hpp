@@ -0,0 +1,40 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include <stddef.h>
+
+namespace ne
+{
+  //One vertex buffer and one index buffer shared by every static mesh, so
+  //meshes draw without switching vertex arrays and a whole pass can go out
+  //in a single multi-draw. Vertices are interleaved position, UV, normal.
+  class GeometryArena
+  {
+  public:
+    static GeometryArena& Static(); //The arena holding every StaticMesh
+
+    //Copy a mesh in. The returned base vertex and first index count
+    //vertices and indices rather than bytes.
+    void Allocate(const GLfloat* vertices, size_t numVerts, const GLuint* indices, size_t numIndices,
+        GLint& outBaseVertex, GLuint& outFirstIndex);
+    //Ranges are not reused, the buffers are freed once every mesh has been released
+    void Release();
+
+    GLuint VertexArray() const { return m_vaoConfig; }
+
+    static const int FLOATS_PER_VERTEX = 8;
+
+  private:
+    GeometryArena();
+    void Reserve(GLuint& buffer, size_t& capacity, size_t used, size_t needed, size_t initial);
+
+    GLuint m_vaoConfig;
+    GLuint m_vboVertices;
+    GLuint m_vboIndices;
+    size_t m_vertexCapacity; //In bytes
+    size_t m_vertexSize; //In bytes
+    size_t m_indexCapacity; //In bytes
+    size_t m_indexSize; //In bytes
+    size_t m_numAllocations; //Meshes not yet released
+  };
+}
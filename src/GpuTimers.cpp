@@ -0,0 +1,114 @@
+#include "GpuTimers.hpp"
+
+#include <cstring>
+
+namespace ne
+{
+
+  GpuTimers::GpuTimers() :
+    m_current(0)
+  {
+    for(Frame& frame : m_frames)
+    {
+      frame.numQueries = 0;
+      frame.bPending = false;
+    }
+  }
+
+  GpuTimers::~GpuTimers()
+  {
+    for(Frame& frame : m_frames)
+    {
+      if(!frame.queries.empty())
+        glDeleteQueries(frame.queries.size(), frame.queries.data());
+    }
+  }
+
+  bool GpuTimers::BeginFrame()
+  {
+    //Oldest first, so the newest finished frame is the one left in m_lastFrame
+    bool bCollected = false;
+    for(int i = 1; i <= FRAMES_IN_FLIGHT; ++i)
+      bCollected |= Collect(m_frames[(m_current + i) % FRAMES_IN_FLIGHT]);
+
+    //Anything still pending in the set about to be reused is given up on rather than waited for
+    m_current = (m_current + 1) % FRAMES_IN_FLIGHT;
+    Frame& frame = m_frames[m_current];
+    frame.numQueries = 0;
+    frame.records.clear();
+    frame.bPending = false;
+    m_open.clear();
+    return bCollected;
+  }
+
+  void GpuTimers::Begin(const char* name, int index)
+  {
+    Frame& frame = m_frames[m_current];
+    m_open.push_back(frame.records.size());
+    frame.records.push_back(Record{name, index, (int)m_open.size() - 1, Timestamp(), 0});
+  }
+
+  void GpuTimers::End()
+  {
+    if(m_open.empty())
+      return;
+
+    Frame& frame = m_frames[m_current];
+    frame.records[m_open.back()].end = Timestamp();
+    m_open.pop_back();
+
+    //Results are only looked at once every scope has closed
+    frame.bPending = m_open.empty();
+  }
+
+  double GpuTimers::Time(const char* name) const
+  {
+    double time = 0.0;
+    for(const GpuScope& scope : m_lastFrame)
+    {
+      if(std::strcmp(scope.name, name) == 0)
+        time += scope.time;
+    }
+    return time;
+  }
+
+  size_t GpuTimers::Timestamp()
+  {
+    Frame& frame = m_frames[m_current];
+    if(frame.numQueries == frame.queries.size())
+    {
+      GLuint query;
+      glGenQueries(1, &query);
+      frame.queries.push_back(query);
+    }
+
+    glQueryCounter(frame.queries[frame.numQueries], GL_TIMESTAMP);
+    return frame.numQueries++;
+  }
+
+  bool GpuTimers::Collect(Frame& frame)
+  {
+    if(!frame.bPending || frame.records.empty())
+      return false;
+
+    //Timestamps land in order, so once the last has the rest have too
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+      return false;
+
+    std::vector<GLuint64> stamps(frame.numQueries);
+    for(size_t i = 0; i < frame.numQueries; ++i)
+      glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+    m_lastFrame.clear();
+    for(const Record& record : frame.records)
+    {
+      const double time = double(stamps[record.end] - stamps[record.begin]) / 1e6;
+      m_lastFrame.push_back(GpuScope{record.name, record.index, record.depth, stamps[record.begin], time});
+    }
+
+    frame.bPending = false;
+    return true;
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include <stddef.h>
+#include <vector>
+
+namespace ne
+{
+  //GPU time taken by one named scope of a frame
+  struct GpuScope
+  {
+    const char* name; //Static string, Time() matches scopes by its contents
+    int index; //Which light for per light scopes, -1 otherwise
+    int depth; //0 for the outermost scope
+    GLuint64 start; //GPU clock, in nanoseconds
+    double time; //In milliseconds
+  };
+
+  //Timestamp queries for nested, named scopes, with a set per frame in flight.
+  //A frame's results are only read once the GPU reports them available, so
+  //recording a frame never waits on one drawn earlier. A frame whose queries
+  //are still pending when its set comes round again is dropped.
+  class GpuTimers
+  {
+  public:
+    GpuTimers();
+    ~GpuTimers();
+
+    //Collect whichever frames have finished and start recording the next,
+    //true when that brought a newer frame into LastFrame()
+    bool BeginFrame();
+
+    //Each Begin needs an End, scopes opened inside another nest beneath it
+    void Begin(const char* name, int index = -1);
+    void End();
+
+    //The latest frame whose results have all come back, empty until then
+    const std::vector<GpuScope>& LastFrame() const { return m_lastFrame; }
+    //Summed over every scope of that name in LastFrame()
+    double Time(const char* name) const;
+
+    static const int FRAMES_IN_FLIGHT = 4;
+
+  private:
+    struct Record
+    {
+      const char* name;
+      int index;
+      int depth;
+      size_t begin; //Into the frame's queries
+      size_t end;
+    };
+
+    struct Frame
+    {
+      std::vector<GLuint> queries; //Grown as needed and kept, two per scope
+      size_t numQueries; //Issued this time round
+      std::vector<Record> records; //In the order their scopes began
+      bool bPending; //Issued and not yet read back
+    };
+
+    GpuTimers(const GpuTimers&) = delete;
+    GpuTimers& operator=(const GpuTimers&) = delete;
+
+    size_t Timestamp();
+    bool Collect(Frame& frame);
+
+    Frame m_frames[FRAMES_IN_FLIGHT];
+    int m_current; //Frame being recorded
+    std::vector<size_t> m_open; //Records of the scopes begun and not yet ended
+    std::vector<GpuScope> m_lastFrame;
+  };
+}
@@ -1,4 +1,6 @@
 #include "ImguiWrapper.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
 
 #include <SDL2/SDL.h>
 #include <imgui.h>
@@ -39,9 +41,6 @@ namespace ne
       io.KeyMap[ImGuiKey_Z] = SDLK_z;
     }
 
-    glGenBuffers(1, &m_vboVertices);
-    glGenBuffers(1, &m_vboIndices);
-
     // Set up shader for the gui
     {
       const GLchar *vertexSrc = 
@@ -97,7 +96,7 @@ namespace ne
       int width, height;
       io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height); 
       glGenTextures(1, &m_texFont);
-      glBindTexture(GL_TEXTURE_2D, m_texFont);
+      GLState::Current().BindTexture(0, GL_TEXTURE_2D, m_texFont);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
@@ -112,9 +111,7 @@ namespace ne
   ImguiWrapper::~ImguiWrapper()
   {
     glDeleteProgram(m_shader);
-    glDeleteTextures(1, &m_texFont);
-    glDeleteBuffers(1, &m_vboVertices);
-    glDeleteBuffers(1, &m_vboIndices);
+    GLState::Current().DeleteTextures(1, &m_texFont);
   }
 
   void ImguiWrapper::NewFrame(SDL_Window *window)
@@ -150,24 +147,25 @@ namespace ne
     ImGui::NewFrame();
   }
 
-  void ImguiWrapper::Render()
+  void ImguiWrapper::Render(StreamBuffer& stream)
   {
+    NE_PROFILE_ZONE("ImguiWrapper::Render");
     ImGuiIO& io = ImGui::GetIO();
     ImGui::Render();
     ImDrawData *drawData = ImGui::GetDrawData();
 
     // Setup render state: alpha-blending enabled, no face culling, no depth testing, scissor enabled
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_SCISSOR_TEST);
-    glActiveTexture(GL_TEXTURE0);
+    GLState& state = GLState::Current();
+    state.PolygonMode(GL_FILL);
+    state.Enable(GL_BLEND);
+    state.BlendEquation(GL_FUNC_ADD);
+    state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.Disable(GL_CULL_FACE);
+    state.Disable(GL_DEPTH_TEST);
+    state.Enable(GL_SCISSOR_TEST);
 
     // Handle cases of screen coordinates != from framebuffer coordinates (e.g. retina displays)
-    glViewport(0, 0, io.DisplaySize.x, io.DisplaySize.y);
+    state.Viewport(0, 0, io.DisplaySize.x, io.DisplaySize.y);
     const float frameBufferHeight = io.DisplaySize.y * io.DisplayFramebufferScale.y;
     drawData->ScaleClipRects(io.DisplayFramebufferScale);
 
@@ -179,30 +177,34 @@ namespace ne
       {-1.0f,                  1.0f,                   0.0f, 1.0f },
     };
 
-    glUseProgram(m_shader);
+    state.UseProgram(m_shader);
     glUniform1i(glGetUniformLocation(m_shader, "texture"), 0);
     glUniformMatrix4fv(glGetUniformLocation(m_shader, "matView"), 1, GL_FALSE, &ortho_projection[0][0]);
 
-    // Render command lists
-    glBindBuffer(GL_ARRAY_BUFFER, m_vboVertices);
+    // Render command lists, written into the renderer's stream buffer alongside its own per frame data
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, pos));
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, uv));
-    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, col));
-
     for(int n = 0; n < drawData->CmdListsCount; n++)
     {
       const ImDrawList* cmd_list = drawData->CmdLists[n];
-      const ImDrawIdx* idx_buffer_offset = 0;
-
-      glBindBuffer(GL_ARRAY_BUFFER, m_vboVertices);
-      glBufferData(GL_ARRAY_BUFFER, cmd_list->VtxBuffer.size() * sizeof(ImDrawVert), &cmd_list->VtxBuffer.front(), GL_STREAM_DRAW);
 
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vboIndices);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx), &cmd_list->IdxBuffer.front(), GL_STREAM_DRAW);
+      //Vertices and indices are reserved together, two pushes could land in different buffers if the second outgrew the ring.
+      //ImDrawVert is a whole number of floats, so the indices that follow stay aligned.
+      const size_t vtxSize = cmd_list->VtxBuffer.size() * sizeof(ImDrawVert);
+      const GLintptr vtxOffset = stream.Allocate(vtxSize + cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx), sizeof(float));
+      const GLintptr idxOffset = vtxOffset + vtxSize;
+      stream.Write(vtxOffset, &cmd_list->VtxBuffer.front(), vtxSize);
+      stream.Write(idxOffset, &cmd_list->IdxBuffer.front(), cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx));
+      const ImDrawIdx* idx_buffer_offset = (const ImDrawIdx*)idxOffset;
+
+      //Bound after writing, as a write that outgrows the ring moves it to a new buffer
+      glBindBuffer(GL_ARRAY_BUFFER, stream.Buffer());
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream.Buffer());
+      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(vtxOffset + offsetof(ImDrawVert, pos)));
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(vtxOffset + offsetof(ImDrawVert, uv)));
+      glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)(vtxOffset + offsetof(ImDrawVert, col)));
 
       for(const ImDrawCmd* cmd = cmd_list->CmdBuffer.begin(); cmd != cmd_list->CmdBuffer.end(); cmd++)
       {
@@ -212,7 +214,7 @@ namespace ne
         }
         else
         {
-          glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)cmd->TextureId);
+          state.BindTexture(0, GL_TEXTURE_2D, (GLuint)(intptr_t)cmd->TextureId);
           glScissor(cmd->ClipRect.x,
                     frameBufferHeight - cmd->ClipRect.w,
                     cmd->ClipRect.z - cmd->ClipRect.x,
@@ -226,9 +228,9 @@ namespace ne
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(2);
-    glDisable(GL_SCISSOR_TEST);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    state.Disable(GL_SCISSOR_TEST);
+    state.Enable(GL_CULL_FACE);
+    state.Enable(GL_DEPTH_TEST);
   }
 
   void ImguiWrapper::HandleEvent(const SDL_Event *event)
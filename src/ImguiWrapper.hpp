@@ -1,6 +1,7 @@
 #pragma once
 
 #include "OpenGL.hpp"
+#include "StreamBuffer.hpp"
 
 #include <imgui.h>
 #include <SDL2/SDL.h>
@@ -15,7 +16,7 @@ namespace ne
     ~ImguiWrapper();
 
     void NewFrame(SDL_Window *window);
-    void Render();
+    void Render(StreamBuffer& stream);
     void HandleEvent(const SDL_Event *e);
     bool UsingMouse();
     bool UsingKeyboard();
@@ -27,7 +28,5 @@ namespace ne
     
     GLuint m_texFont;
     GLuint m_shader;
-    GLuint m_vboVertices;
-    GLuint m_vboIndices;
   };
 }
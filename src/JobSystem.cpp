@@ -0,0 +1,94 @@
+#include "JobSystem.hpp"
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace ne
+{
+
+  JobSystem::JobSystem(int numWorkers) :
+    m_pJob(nullptr),
+    m_count(0),
+    m_next(0),
+    m_busy(0),
+    m_batch(0),
+    m_bQuit(false)
+  {
+    if(numWorkers < 0)
+      numWorkers = std::max<int>(std::thread::hardware_concurrency(), 1) - 1;
+
+    for(int i = 0; i < numWorkers; ++i)
+      m_workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+  }
+
+  JobSystem::~JobSystem()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_bQuit = true;
+    }
+    m_wake.notify_all();
+
+    for(std::thread& worker : m_workers)
+      worker.join();
+  }
+
+  void JobSystem::ParallelFor(size_t count, const std::function<void(size_t, int)>& job)
+  {
+    //Not worth waking anyone for
+    if(m_workers.empty() || count <= 1)
+    {
+      for(size_t i = 0; i < count; ++i)
+        job(i, 0);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pJob = &job;
+      m_count = count;
+      m_next.store(0, std::memory_order_relaxed);
+      m_busy = m_workers.size();
+      ++m_batch;
+    }
+    m_wake.notify_all();
+
+    RunJobs(0);
+
+    //Every index has been handed out, but workers may still be inside theirs
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_pJob = nullptr;
+  }
+
+  void JobSystem::WorkerLoop(int thread)
+  {
+    Profiler::Instance().SetThreadName(("Worker " + std::to_string(thread)).c_str());
+
+    uint64_t lastBatch = 0;
+    for(;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [&] { return m_bQuit || m_batch != lastBatch; });
+        if(m_bQuit)
+          return;
+        lastBatch = m_batch;
+      }
+
+      RunJobs(thread);
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if(--m_busy == 0)
+        m_done.notify_one();
+    }
+  }
+
+  void JobSystem::RunJobs(int thread)
+  {
+    for(size_t i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1))
+      (*m_pJob)(i, thread);
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace ne
+{
+  //A fixed pool of worker threads for spreading a frame's CPU work. The calling
+  //thread works through the jobs alongside them, so a pool without workers
+  //still runs everything, just on the one thread.
+  class JobSystem
+  {
+  public:
+    //Negative for one worker per core besides the caller's
+    explicit JobSystem(int numWorkers = -1);
+    ~JobSystem();
+
+    //Calls job(index, thread) for every index below count and returns once all have finished.
+    //thread is below NumThreads() and no two jobs running at once share it, so it can pick scratch space.
+    void ParallelFor(size_t count, const std::function<void(size_t, int)>& job);
+
+    //Workers plus the caller
+    int NumThreads() const { return m_workers.size() + 1; }
+
+  private:
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    void WorkerLoop(int thread);
+    void RunJobs(int thread);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake; //Workers wait here for a new batch
+    std::condition_variable m_done; //The caller waits here for workers to leave the batch
+    const std::function<void(size_t, int)>* m_pJob; //The current batch, set under m_mutex
+    size_t m_count;
+    std::atomic<size_t> m_next; //Next index to hand out
+    int m_busy; //Workers yet to finish the current batch
+    uint64_t m_batch; //Bumped for each batch so workers can tell a new one from a spurious wake
+    bool m_bQuit;
+  };
+}
@@ -1,12 +1,17 @@
 #include "Loader.hpp"
 
 #include "Animation.hpp"
+#include "Bounds.hpp"
+#include "GeometryArena.hpp"
+#include "GLState.hpp"
+#include "TextureArrays.hpp"
 #include "Material.hpp"
 #include "StaticMesh.hpp"
 #include "StaticModel.hpp"
 #include "AnimatedMesh.hpp"
 #include "AnimatedModel.hpp"
 #include "Texture.hpp"
+#include "Profiler.hpp"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -62,6 +67,40 @@ namespace ne
       readBytes(in, (char*)&ret[0][0], 16 * 4);
       return ret;
     }
+
+    //Animated meshes are bounded in their bind pose, so leave room for the
+    //limbs to move. Expressed as a fraction of the largest half extent.
+    const float ANIMATED_BOUNDS_PADDING = 0.25f;
+
+    //Calculate the bounds of interleaved vertex data, positions first in each vertex
+    Bounds calculateBounds(const GLfloat* vertices, size_t numVerts, size_t stride)
+    {
+      Bounds bounds;
+      if(numVerts == 0)
+        return bounds;
+
+      bounds.min = glm::vec3(vertices[0], vertices[1], vertices[2]);
+      bounds.max = bounds.min;
+      for(size_t i = 1; i < numVerts; ++i)
+      {
+        const GLfloat* v = &vertices[i * stride];
+        bounds.min = glm::min(bounds.min, glm::vec3(v[0], v[1], v[2]));
+        bounds.max = glm::max(bounds.max, glm::vec3(v[0], v[1], v[2]));
+      }
+
+      //Fit the sphere around the actual vertices rather than the box corners
+      bounds.center = (bounds.min + bounds.max) * 0.5f;
+      float radiusSq = 0.0f;
+      for(size_t i = 0; i < numVerts; ++i)
+      {
+        const GLfloat* v = &vertices[i * stride];
+        const glm::vec3 offset = glm::vec3(v[0], v[1], v[2]) - bounds.center;
+        radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+      }
+      bounds.radius = glm::sqrt(radiusSq);
+
+      return bounds;
+    }
   }
 
   Loader::Loader()
@@ -80,6 +119,7 @@ namespace ne
 
   StaticMesh* Loader::LoadStaticMesh(const aiMesh* mesh)
   {
+    NE_PROFILE_ZONE("Loader::LoadStaticMesh");
     std::vector<GLfloat> data;
     for(GLuint i = 0; i < mesh->mNumVertices; ++i)
     {
@@ -110,34 +150,19 @@ namespace ne
       }
     }
 
-    StaticMesh* pMesh = new StaticMesh();
-    pMesh->m_iNumTris = data.size() / 24; //(8 floats per vertex, 3 vertices per tri)
-    pMesh->m_iNumIndices = indices.size();
-    pMesh->m_iStride = 8 * sizeof(GLfloat);
-    pMesh->m_iOffPos = 0 * sizeof(GLfloat);
-    pMesh->m_iOffUV = 3 * sizeof(GLfloat);
-    pMesh->m_iOffNormal = 5 * sizeof(GLfloat);
-
-    glGenVertexArrays(1, &pMesh->m_vaoConfig);
-    glGenBuffers(1, &pMesh->m_vboVertices);
-    glGenBuffers(1, &pMesh->m_vboIndices);
-
-    glBindVertexArray(pMesh->m_vaoConfig);
-
-    glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), &data[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->m_vboIndices);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    return CreateStaticMesh(&data[0], mesh->mNumVertices, &indices[0], indices.size());
+  }
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffUV);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffNormal);
+  StaticMesh* Loader::CreateStaticMesh(const GLfloat* vertices, size_t numVerts, const GLuint* indices, size_t numIndices)
+  {
+    StaticMesh* pMesh = new StaticMesh();
+    pMesh->m_iNumTris = numIndices / 3;
+    pMesh->m_iNumIndices = numIndices;
+    pMesh->m_bounds = calculateBounds(vertices, numVerts, GeometryArena::FLOATS_PER_VERTEX);
 
-    glBindVertexArray(0);
+    GeometryArena& arena = GeometryArena::Static();
+    arena.Allocate(vertices, numVerts, indices, numIndices, pMesh->m_iBaseVertex, pMesh->m_iFirstIndex);
+    pMesh->m_vaoConfig = arena.VertexArray();
 
     return pMesh;
   }
@@ -178,6 +203,7 @@ namespace ne
 
   StaticModel* Loader::LoadStaticModel(const std::string &path)
   {
+    NE_PROFILE_ZONE("Loader::LoadStaticModel");
     //Check cache
     {
       auto it = m_staticModels.find(path);
@@ -209,6 +235,7 @@ namespace ne
 
   Skeleton* Loader::LoadSkeleton(const std::string& path)
   {
+    NE_PROFILE_ZONE("Loader::LoadSkeleton");
     std::ifstream in(path);
 
     if(!in.good())
@@ -245,6 +272,7 @@ namespace ne
 
   StaticMesh* Loader::LoadBakedStaticMesh(const std::string& path)
   {
+    NE_PROFILE_ZONE("Loader::LoadBakedStaticMesh");
     std::ifstream in(path);
 
     if(!in.good())
@@ -259,7 +287,7 @@ namespace ne
     const size_t numVerts = readU32(in);
     const size_t numIndices = readU32(in);
 
-    std::vector<GLfloat> vertexData(16 * numVerts);
+    std::vector<GLfloat> vertexData(8 * numVerts);
     std::vector<GLuint> indexData(numIndices);
 
     //Load all the vertex data in one go
@@ -268,42 +296,23 @@ namespace ne
     //Load all the index data in one go
     readBytes(in, (char*)&indexData[0], 4 * numIndices);
 
-    StaticMesh* pMesh = new StaticMesh();
-    pMesh->m_iNumTris = numVerts / 3;
-    pMesh->m_iNumIndices = numIndices;
-    pMesh->m_iStride = 8 * sizeof(GLfloat);
-    pMesh->m_iOffPos = 0 * sizeof(GLfloat);
-    pMesh->m_iOffNormal = 3 * sizeof(GLfloat);
-    pMesh->m_iOffUV = 6 * sizeof(GLfloat);
-
-    glGenVertexArrays(1, &pMesh->m_vaoConfig);
-    glGenBuffers(1, &pMesh->m_vboVertices);
-    glGenBuffers(1, &pMesh->m_vboIndices);
-
-    glBindVertexArray(pMesh->m_vaoConfig);
-
-    glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
-    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(GLfloat), &vertexData[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->m_vboIndices);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(GLuint), &indexData[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffUV);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffNormal);
-
-    glBindVertexArray(0);
+    //Baked vertices are position, normal, UV, swap them round to the arena's position, UV, normal
+    std::vector<GLfloat> arenaData(8 * numVerts);
+    for(size_t i = 0; i < numVerts; ++i)
+    {
+      const GLfloat* v = &vertexData[i * 8];
+      GLfloat* out = &arenaData[i * 8];
+      out[0] = v[0]; out[1] = v[1]; out[2] = v[2];
+      out[3] = v[6]; out[4] = v[7];
+      out[5] = v[3]; out[6] = v[4]; out[7] = v[5];
+    }
 
-    return pMesh;
+    return CreateStaticMesh(&arenaData[0], numVerts, &indexData[0], numIndices);
   }
 
   AnimatedMesh* Loader::LoadAnimatedMesh(const std::string& path)
   {
+    NE_PROFILE_ZONE("Loader::LoadAnimatedMesh");
     std::ifstream in(path);
 
     if(!in.good())
@@ -337,11 +346,18 @@ namespace ne
     pMesh->m_iOffBoneWeights = 8 * sizeof(GLfloat);
     pMesh->m_iOffBoneIds = 12 * sizeof(GLfloat);
 
+    pMesh->m_bounds = calculateBounds(&vertexData[0], numVerts, 16);
+    const glm::vec3 halfExtent = (pMesh->m_bounds.max - pMesh->m_bounds.min) * 0.5f;
+    const float padding = ANIMATED_BOUNDS_PADDING * std::max(halfExtent.x, std::max(halfExtent.y, halfExtent.z));
+    pMesh->m_bounds.min -= glm::vec3(padding);
+    pMesh->m_bounds.max += glm::vec3(padding);
+    pMesh->m_bounds.radius += padding;
+
     glGenVertexArrays(1, &pMesh->m_vaoConfig);
     glGenBuffers(1, &pMesh->m_vboVertices);
     glGenBuffers(1, &pMesh->m_vboIndices);
 
-    glBindVertexArray(pMesh->m_vaoConfig);
+    GLState::Current().BindVertexArray(pMesh->m_vaoConfig);
 
     glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
     glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(GLfloat), &vertexData[0], GL_STATIC_DRAW);
@@ -362,13 +378,14 @@ namespace ne
     glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffBoneWeights);
     glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffBoneIds);
 
-    glBindVertexArray(0);
+    GLState::Current().BindVertexArray(0);
 
     return pMesh;
   }
 
   Animation* Loader::LoadAnimation(const std::string& path)
   {
+    NE_PROFILE_ZONE("Loader::LoadAnimation");
     std::ifstream in(path);
 
     if(!in.good())
@@ -412,6 +429,7 @@ namespace ne
 
   Texture* Loader::LoadTexture(const std::string &path, enum TextureFormat format)
   {
+    NE_PROFILE_ZONE("Loader::LoadTexture");
     {
       auto it = m_textures.find(path);
       if(it != m_textures.end()) {
@@ -474,16 +492,8 @@ namespace ne
 
     Texture *pTex = new Texture();
     pTex->m_width = width;
-    pTex->m_height = width;
-    glGenTextures(1, &pTex->m_glTexture);
-    glBindTexture(GL_TEXTURE_2D, pTex->m_glTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, &data[0]);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    pTex->m_height = height;
+    TextureArrays::Static().Allocate(width, height, internalFormat, true, &data[0], pTex->m_glTexture, pTex->m_layer);
 
     m_textures[path] = pTex;
     return pTex;
@@ -504,14 +514,7 @@ namespace ne
     Texture *pTex = new Texture();
     pTex->m_width = size;
     pTex->m_height = size;
-    glGenTextures(1, &pTex->m_glTexture);
-    glBindTexture(GL_TEXTURE_2D, pTex->m_glTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureArrays::Static().Allocate(size, size, GL_RGB8, false, &pixels[0], pTex->m_glTexture, pTex->m_layer);
 
     return pTex;
   }
@@ -529,14 +532,7 @@ namespace ne
     Texture *pTex = new Texture();
     pTex->m_width = size;
     pTex->m_height = size;
-    glGenTextures(1, &pTex->m_glTexture);
-    glBindTexture(GL_TEXTURE_2D, pTex->m_glTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureArrays::Static().Allocate(size, size, GL_RGB8, false, &pixels[0], pTex->m_glTexture, pTex->m_layer);
 
     return pTex;
   }
@@ -560,27 +556,13 @@ namespace ne
     Texture *pTex = new Texture();
     pTex->m_width = size;
     pTex->m_height = size;
-    glGenTextures(1, &pTex->m_glTexture);
-    glBindTexture(GL_TEXTURE_2D, pTex->m_glTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureArrays::Static().Allocate(size, size, GL_RGB8, false, &pixels[0], pTex->m_glTexture, pTex->m_layer);
 
     return pTex;
   }
 
   StaticMesh* Loader::GeneratePlane()
   {
-    StaticMesh *pMesh = new StaticMesh();
-    pMesh->m_iNumTris = 2;
-    pMesh->m_iStride = 8 * sizeof(GLfloat);
-    pMesh->m_iOffPos = 0 * sizeof(GLfloat);
-    pMesh->m_iOffUV = 3 * sizeof(GLfloat);
-    pMesh->m_iOffNormal = 5 * sizeof(GLfloat);
-
     std::vector<GLfloat> data = {
       -1,-1,0, 0,0, 0,0,1,
        1, 1,0, 1,1, 0,0,1,
@@ -590,36 +572,16 @@ namespace ne
        1, 1,0, 1,1, 0,0,1
     };
 
-    glGenVertexArrays(1, &pMesh->m_vaoConfig);
-    glGenBuffers(1, &pMesh->m_vboVertices);
+    //Every vertex is used once
+    std::vector<GLuint> indices(data.size() / 8);
+    for(size_t i = 0; i < indices.size(); ++i)
+      indices[i] = i;
 
-    glBindVertexArray(pMesh->m_vaoConfig);
-
-    glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), &data[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffUV);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffNormal);
-
-    glBindVertexArray(0);
-
-    return pMesh;
+    return CreateStaticMesh(&data[0], data.size() / 8, &indices[0], indices.size());
   }
 
   StaticMesh* Loader::GenerateCube()
   {
-    StaticMesh *pMesh = new StaticMesh();
-
-    pMesh->m_iNumTris = 12;
-    pMesh->m_iStride = 8 * sizeof(GLfloat);
-    pMesh->m_iOffPos = 0 * sizeof(GLfloat);
-    pMesh->m_iOffUV = 3 * sizeof(GLfloat);
-    pMesh->m_iOffNormal = 5 * sizeof(GLfloat);
-
     std::vector<GLfloat> data = {
       -1,-1,-1, 0,0, 0,0,-1,
       -1, 1,-1, 0,1, 0,0,-1,
@@ -664,24 +626,12 @@ namespace ne
        1, 1, 1, 1,1, 1,0,0,
     };
 
-    glGenVertexArrays(1, &pMesh->m_vaoConfig);
-    glGenBuffers(1, &pMesh->m_vboVertices);
-
-    glBindVertexArray(pMesh->m_vaoConfig);
+    //Every vertex is used once
+    std::vector<GLuint> indices(data.size() / 8);
+    for(size_t i = 0; i < indices.size(); ++i)
+      indices[i] = i;
 
-    glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), &data[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffUV);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffNormal);
-
-    glBindVertexArray(0);
-
-    return pMesh;
+    return CreateStaticMesh(&data[0], data.size() / 8, &indices[0], indices.size());
   }
 
   StaticMesh* Loader::GenerateSphere()
@@ -716,7 +666,7 @@ namespace ne
 
     for(int i = 1; i < numRows - 0; ++i)
     {
-      const float y = 0.5 * cos(i / glm::pi<float>());
+      const float y = 0.5 * cos(i * glm::pi<float>() / numRows);
       const float r = 0.5;
       const float width = glm::sqrt(r * r - y * y);
 
@@ -776,40 +726,81 @@ namespace ne
       const int left = i;
       const int right = (i + 1) % numCols;
       indices.push_back(1);
-      indices.push_back(left + lastRingBaseIndex);
       indices.push_back(right + lastRingBaseIndex);
+      indices.push_back(left + lastRingBaseIndex);
     }
 
-    StaticMesh *pMesh = new StaticMesh();
-    pMesh->m_iNumTris = indices.size() / 3;
-    pMesh->m_iNumIndices = indices.size();
-    pMesh->m_iStride = 8 * sizeof(GLfloat);
-    pMesh->m_iOffPos = 0 * sizeof(GLfloat);
-    pMesh->m_iOffUV = 3 * sizeof(GLfloat);
-    pMesh->m_iOffNormal = 5 * sizeof(GLfloat);
+    return CreateStaticMesh(&verts[0], verts.size() / 8, &indices[0], indices.size());
+  }
 
-    glGenVertexArrays(1, &pMesh->m_vaoConfig);
-    glGenBuffers(1, &pMesh->m_vboVertices);
-    glGenBuffers(1, &pMesh->m_vboIndices);
+  StaticMesh* Loader::GenerateCone()
+  {
+    std::vector<GLfloat> verts;
+    std::vector<GLuint> indices;
 
-    glBindVertexArray(pMesh->m_vaoConfig);
+    //Apex at the origin, opening down -z to a unit radius base at z = -1
+    const int numCols = 18;
+    const int apexIndex = 0;
+    const int baseIndex = 1;
+    const int firstRingBaseIndex = 2;
+    const float colInc = 2.0 * glm::pi<float>() / numCols;
 
-    glBindBuffer(GL_ARRAY_BUFFER, pMesh->m_vboVertices);
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GLfloat), &verts[0], GL_STATIC_DRAW);
+    //Apex
+    verts.push_back(0.0); //x
+    verts.push_back(0.0); //y
+    verts.push_back(0.0); //z
+    verts.push_back(0.0); //u
+    verts.push_back(0.0); //v
+    verts.push_back(0.0); //normal.x
+    verts.push_back(0.0); //normal.y
+    verts.push_back(1.0); //normal.z
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->m_vboIndices);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    //Center of the base
+    verts.push_back(0.0); //x
+    verts.push_back(0.0); //y
+    verts.push_back(-1.0); //z
+    verts.push_back(0.0); //u
+    verts.push_back(0.0); //v
+    verts.push_back(0.0); //normal.x
+    verts.push_back(0.0); //normal.y
+    verts.push_back(-1.0); //normal.z
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffUV);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, pMesh->m_iStride, (void*)pMesh->m_iOffNormal);
+    for(int i = 0; i < numCols; ++i)
+    {
+      const float x = cos(i * colInc);
+      const float y = sin(i * colInc);
+      const glm::vec3 normal = glm::normalize(glm::vec3(x, y, 1.0));
 
-    glBindVertexArray(0);
+      verts.push_back(x);
+      verts.push_back(y);
+      verts.push_back(-1.0);
 
-    return pMesh;
+      //U,V
+      verts.push_back(0.0);
+      verts.push_back(0.0);
+
+      verts.push_back(normal.x);
+      verts.push_back(normal.y);
+      verts.push_back(normal.z);
+    }
+
+    for(int i = 0; i < numCols; ++i)
+    {
+      const int left = i + firstRingBaseIndex;
+      const int right = (i + 1) % numCols + firstRingBaseIndex;
+
+      //Side
+      indices.push_back(apexIndex);
+      indices.push_back(left);
+      indices.push_back(right);
+
+      //Base
+      indices.push_back(baseIndex);
+      indices.push_back(right);
+      indices.push_back(left);
+    }
+
+    return CreateStaticMesh(&verts[0], verts.size() / 8, &indices[0], indices.size());
   }
 
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include "OpenGL.hpp"
 #include <unordered_map>
 
 class aiAnimation;
@@ -34,6 +35,7 @@ namespace ne
     static StaticMesh* GeneratePlane();
     static StaticMesh* GenerateCube();
     static StaticMesh* GenerateSphere();
+    static StaticMesh* GenerateCone();
     static Texture* GenerateBlankNormal();
     static Texture* GenerateBlankMap(unsigned char value);
     static Texture* GeneratePurpleCheques();
@@ -49,6 +51,8 @@ namespace ne
   private:
     void ProcessModelNode(StaticModel* model, const aiScene* scene, const aiNode* node);
     StaticMesh* LoadStaticMesh(const aiMesh* mesh);
+    //Static meshes all live in the shared GeometryArena, vertices interleaved position, UV, normal
+    static StaticMesh* CreateStaticMesh(const GLfloat* vertices, size_t numVerts, const GLuint* indices, size_t numIndices);
 
 
     std::unordered_map<std::string, Texture*> m_textures;
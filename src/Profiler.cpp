@@ -0,0 +1,248 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace ne
+{
+
+  namespace
+  {
+    thread_local int t_depth = 0; //Zones open on this thread
+
+    void WriteString(std::ostream& out, const char* str)
+    {
+      out << '"';
+      for(; *str; ++str)
+      {
+        if(*str == '"' || *str == '\\')
+          out << '\\';
+        out << *str;
+      }
+      out << '"';
+    }
+
+    void WriteEvent(std::ostream& out, bool& bFirst, const char* name, int tid, double start, double duration)
+    {
+      out << (bFirst ? "\n" : ",\n") << "{\"name\":";
+      WriteString(out, name);
+      out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid << ",\"ts\":" << start << ",\"dur\":" << duration;
+      bFirst = false;
+    }
+  }
+
+  Profiler& Profiler::Instance()
+  {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  uint64_t Profiler::Now()
+  {
+    //rdtsc would be cheaper still, but needs calibrating and isn't steady across cores everywhere
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  Profiler::Profiler() :
+    m_mainThread(-1),
+    m_frameStarts(FRAMES_KEPT, 0),
+    m_numFrames(0),
+    m_gpuFrames(GPU_FRAMES_KEPT),
+    m_numGpuFrames(0)
+  {
+  }
+
+  void Profiler::NextFrame()
+  {
+    if(m_mainThread < 0)
+    {
+      ThreadZones& thread = CurrentThread();
+      std::lock_guard<std::mutex> lock(m_threadsMutex);
+      m_mainThread = thread.index;
+      thread.name = "Main";
+    }
+
+    m_frameStarts[m_numFrames % FRAMES_KEPT] = Now();
+    ++m_numFrames;
+  }
+
+  void Profiler::SetThreadName(const char* name)
+  {
+    ThreadZones& thread = CurrentThread();
+    std::lock_guard<std::mutex> lock(m_threadsMutex);
+    thread.name = name;
+  }
+
+  void Profiler::Record(const char* name, int depth, uint64_t start, uint64_t end)
+  {
+    ThreadZones& thread = CurrentThread();
+    const uint64_t count = thread.count.load(std::memory_order_relaxed);
+    thread.zones[count % ZONES_PER_THREAD] = CpuZone{name, thread.index, depth, start, end};
+    thread.count.store(count + 1, std::memory_order_release);
+  }
+
+  void Profiler::AddGpuFrame(const std::vector<GpuScope>& scopes)
+  {
+    m_gpuFrames[m_numGpuFrames % GPU_FRAMES_KEPT] = scopes;
+    ++m_numGpuFrames;
+  }
+
+  void Profiler::LastFrame(std::vector<CpuZone>& zones, uint64_t& frameStart, uint64_t& frameEnd) const
+  {
+    zones.clear();
+    frameStart = frameEnd = 0;
+    if(m_numFrames < 2)
+      return;
+
+    frameStart = m_frameStarts[(m_numFrames - 2) % FRAMES_KEPT];
+    frameEnd = m_frameStarts[(m_numFrames - 1) % FRAMES_KEPT];
+
+    CopyZones(zones);
+    zones.erase(std::remove_if(zones.begin(), zones.end(), [&](const CpuZone& zone)
+          { return zone.start < frameStart || zone.start >= frameEnd; }), zones.end());
+  }
+
+  bool Profiler::WriteChromeTrace(const std::string& path) const
+  {
+    std::ofstream out(path);
+    if(!out)
+    {
+      std::cerr << "Failed to open trace file " << path << std::endl;
+      return false;
+    }
+
+    std::vector<CpuZone> zones;
+    CopyZones(zones);
+
+    //Both clocks read back to back, the offset between them is good to well under a scope
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    const int64_t gpuOffset = (int64_t)Now() - gpuNow;
+
+    //Times are written in microseconds from whatever was recorded first
+    uint64_t origin = UINT64_MAX;
+    for(const CpuZone& zone : zones)
+      origin = std::min(origin, zone.start);
+
+    const size_t firstFrame = m_numFrames > FRAMES_KEPT ? m_numFrames - FRAMES_KEPT : 0;
+    if(firstFrame < m_numFrames)
+      origin = std::min(origin, m_frameStarts[firstFrame % FRAMES_KEPT]);
+
+    const size_t firstGpuFrame = m_numGpuFrames > GPU_FRAMES_KEPT ? m_numGpuFrames - GPU_FRAMES_KEPT : 0;
+    for(size_t i = firstGpuFrame; i < m_numGpuFrames; ++i)
+    {
+      for(const GpuScope& scope : m_gpuFrames[i % GPU_FRAMES_KEPT])
+        origin = std::min(origin, (uint64_t)(scope.start + gpuOffset));
+    }
+
+    auto toMicro = [origin](int64_t time) { return double(time - (int64_t)origin) / 1e3; };
+
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool bFirst = true;
+
+    int gpuThread = 0;
+    {
+      std::lock_guard<std::mutex> lock(m_threadsMutex);
+      for(const auto& thread : m_threads)
+      {
+        out << (bFirst ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->index << ",\"args\":{\"name\":";
+        WriteString(out, thread->name.c_str());
+        out << "}}";
+        bFirst = false;
+      }
+      gpuThread = m_threads.size();
+    }
+    out << (bFirst ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << gpuThread << ",\"args\":{\"name\":\"GPU\"}}";
+    bFirst = false;
+
+    //Each frame spans from its start to the next, on the main thread beneath its zones
+    for(size_t i = firstFrame; i + 1 < m_numFrames; ++i)
+    {
+      const uint64_t start = m_frameStarts[i % FRAMES_KEPT];
+      const uint64_t end = m_frameStarts[(i + 1) % FRAMES_KEPT];
+      WriteEvent(out, bFirst, "Frame", m_mainThread, toMicro(start), double(end - start) / 1e3);
+      out << "}";
+    }
+
+    for(const CpuZone& zone : zones)
+    {
+      WriteEvent(out, bFirst, zone.name, zone.thread, toMicro(zone.start), double(zone.end - zone.start) / 1e3);
+      out << "}";
+    }
+
+    for(size_t i = firstGpuFrame; i < m_numGpuFrames; ++i)
+    {
+      for(const GpuScope& scope : m_gpuFrames[i % GPU_FRAMES_KEPT])
+      {
+        WriteEvent(out, bFirst, scope.name, gpuThread, toMicro(scope.start + gpuOffset), scope.time * 1e3);
+        if(scope.index >= 0)
+          out << ",\"args\":{\"index\":" << scope.index << "}";
+        out << "}";
+      }
+    }
+
+    out << "\n]}\n";
+    if(!out)
+    {
+      std::cerr << "Failed to write trace file " << path << std::endl;
+      return false;
+    }
+
+    std::cout << "Wrote " << zones.size() << " zones to " << path << std::endl;
+    return true;
+  }
+
+  Profiler::ThreadZones& Profiler::CurrentThread()
+  {
+    thread_local ThreadZones* t_zones = nullptr;
+    if(!t_zones)
+    {
+      std::lock_guard<std::mutex> lock(m_threadsMutex);
+      m_threads.emplace_back(new ThreadZones());
+      t_zones = m_threads.back().get();
+      t_zones->index = m_threads.size() - 1;
+      t_zones->name = "Thread " + std::to_string(t_zones->index);
+      t_zones->count.store(0, std::memory_order_relaxed);
+    }
+    return *t_zones;
+  }
+
+  void Profiler::CopyZones(std::vector<CpuZone>& zones) const
+  {
+    std::lock_guard<std::mutex> lock(m_threadsMutex);
+    for(const auto& thread : m_threads)
+    {
+      const uint64_t count = thread->count.load(std::memory_order_acquire);
+      const uint64_t first = count > ZONES_PER_THREAD ? count - ZONES_PER_THREAD : 0;
+      const size_t copied = zones.size();
+      for(uint64_t i = first; i < count; ++i)
+        zones.push_back(thread->zones[i % ZONES_PER_THREAD]);
+
+      //Anything the owner has written over since, or is writing now, can't be trusted
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t after = thread->count.load(std::memory_order_relaxed) + 1;
+      if(after > first + ZONES_PER_THREAD)
+      {
+        const size_t lost = std::min<uint64_t>(after - ZONES_PER_THREAD - first, count - first);
+        zones.erase(zones.begin() + copied, zones.begin() + copied + lost);
+      }
+    }
+  }
+
+  ProfileZone::ProfileZone(const char* name) :
+    m_name(name),
+    m_start(Profiler::Now())
+  {
+    ++t_depth;
+  }
+
+  ProfileZone::~ProfileZone()
+  {
+    --t_depth;
+    Profiler::Instance().Record(m_name, t_depth, m_start, Profiler::Now());
+  }
+}
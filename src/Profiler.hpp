@@ -0,0 +1,112 @@
+#pragma once
+
+#include "GpuTimers.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//Zones cost nothing in release builds, they go along with asserts
+#ifndef NDEBUG
+#define NE_PROFILING
+#endif
+
+#define NE_PROFILE_JOIN2(a, b) a##b
+#define NE_PROFILE_JOIN(a, b) NE_PROFILE_JOIN2(a, b)
+
+#ifdef NE_PROFILING
+//Times the rest of the enclosing block, name must be a static string
+#define NE_PROFILE_ZONE(name) ne::ProfileZone NE_PROFILE_JOIN(neProfileZone, __LINE__)(name)
+#else
+#define NE_PROFILE_ZONE(name) do {} while(0)
+#endif
+
+namespace ne
+{
+  //CPU time taken by one named zone on one thread
+  struct CpuZone
+  {
+    const char* name; //Static string, as for GPU scopes
+    int thread; //In the order threads first recorded a zone or were named
+    int depth; //0 for the outermost zone on its thread
+    uint64_t start; //Steady clock, in nanoseconds
+    uint64_t end;
+  };
+
+  //Collects zones from every thread into a ring per thread. Only the owning
+  //thread writes a ring, so recording takes no lock, readers copy out what
+  //they want and throw away anything overwritten while they were copying.
+  class Profiler
+  {
+  public:
+    static Profiler& Instance();
+
+    //Current steady clock time, in nanoseconds
+    static uint64_t Now();
+
+    //Called by the main thread as each frame starts, which is how the profiler knows it
+    void NextFrame();
+
+    //Names the calling thread in traces
+    void SetThreadName(const char* name);
+
+    //Called by ProfileZone as it closes
+    void Record(const char* name, int depth, uint64_t start, uint64_t end);
+
+    //Keeps the GPU scopes of a frame to merge into traces
+    void AddGpuFrame(const std::vector<GpuScope>& scopes);
+
+    //Every zone started during the last finished frame, along with that frame's bounds
+    void LastFrame(std::vector<CpuZone>& zones, uint64_t& frameStart, uint64_t& frameEnd) const;
+
+    //Writes everything still held as Chrome trace events (chrome://tracing, Perfetto).
+    //Reads the GL clock to line the GPU scopes up, so call it on the GL thread.
+    bool WriteChromeTrace(const std::string& path) const;
+
+    static const size_t ZONES_PER_THREAD = 16384;
+    static const size_t FRAMES_KEPT = 256;
+    static const size_t GPU_FRAMES_KEPT = 64;
+
+  private:
+    struct ThreadZones
+    {
+      int index;
+      std::string name;
+      CpuZone zones[ZONES_PER_THREAD];
+      std::atomic<uint64_t> count; //Ever recorded, the newest is at (count - 1) % ZONES_PER_THREAD
+    };
+
+    Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    ThreadZones& CurrentThread();
+    void CopyZones(std::vector<CpuZone>& zones) const;
+
+    mutable std::mutex m_threadsMutex; //Only held to add a thread or walk the list
+    std::vector<std::unique_ptr<ThreadZones>> m_threads;
+
+    //Only touched by the main thread
+    int m_mainThread; //Index of the thread calling NextFrame, workers may well have registered first
+    std::vector<uint64_t> m_frameStarts; //Ring of the latest FRAMES_KEPT
+    size_t m_numFrames;
+    std::vector<std::vector<GpuScope>> m_gpuFrames; //Ring of the latest GPU_FRAMES_KEPT
+    size_t m_numGpuFrames;
+  };
+
+  class ProfileZone
+  {
+  public:
+    explicit ProfileZone(const char* name);
+    ~ProfileZone();
+
+  private:
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+    const char* m_name;
+    uint64_t m_start;
+  };
+}
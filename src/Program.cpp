@@ -0,0 +1,120 @@
+#include "Program.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace ne
+{
+
+  Program::Program() : m_program(0)
+  {
+  }
+
+  Program::Program(GLuint program) : m_program(program)
+  {
+    if(m_program)
+      Reflect();
+  }
+
+  Program::Program(Program&& other) : m_program(other.m_program), m_uniforms(std::move(other.m_uniforms))
+  {
+    other.m_program = 0;
+  }
+
+  Program& Program::operator=(Program&& other)
+  {
+    if(this != &other)
+    {
+      if(m_program)
+        glDeleteProgram(m_program);
+      m_program = other.m_program;
+      m_uniforms = std::move(other.m_uniforms);
+      other.m_program = 0;
+    }
+    return *this;
+  }
+
+  Program::~Program()
+  {
+    if(m_program)
+      glDeleteProgram(m_program);
+  }
+
+  void Program::SetSamplers(std::initializer_list<const char*> names) const
+  {
+    GLState::Current().UseProgram(m_program);
+    GLint unit = 0;
+    for(const char* name : names)
+    {
+      const UniformInfo* pInfo = Lookup(name);
+      if(pInfo)
+        glUniform1i(pInfo->location, unit);
+      ++unit;
+    }
+    GLState::Current().UseProgram(0);
+  }
+
+  void Program::SetBlock(const char* name, GLuint binding) const
+  {
+    const GLuint index = glGetUniformBlockIndex(m_program, name);
+    if(index != GL_INVALID_INDEX)
+      glUniformBlockBinding(m_program, index, binding);
+  }
+
+  void Program::Reflect()
+  {
+    GLint numUniforms = 0;
+    GLint maxNameLen = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLen);
+
+    std::vector<char> name(maxNameLen > 0 ? maxNameLen : 1);
+    for(GLint i = 0; i < numUniforms; ++i)
+    {
+      UniformInfo info;
+      GLsizei nameLen = 0;
+      glGetActiveUniform(m_program, i, name.size(), &nameLen, &info.size, &info.type, &name[0]);
+      info.name.assign(&name[0], nameLen);
+      info.location = glGetUniformLocation(m_program, info.name.c_str());
+
+      //Members of uniform blocks have no location of their own
+      if(info.location < 0)
+        continue;
+
+      const size_t arraySuffix = info.name.rfind("[0]");
+      if(arraySuffix != std::string::npos && arraySuffix + 3 == info.name.size())
+        info.name.erase(arraySuffix);
+
+      m_uniforms.push_back(info);
+    }
+
+    std::sort(m_uniforms.begin(), m_uniforms.end(),
+        [](const UniformInfo& a, const UniformInfo& b) { return a.name < b.name; });
+  }
+
+  const Program::UniformInfo* Program::Lookup(const std::string& name) const
+  {
+    auto it = std::lower_bound(m_uniforms.begin(), m_uniforms.end(), name,
+        [](const UniformInfo& info, const std::string& key) { return info.name < key; });
+    if(it == m_uniforms.end() || it->name != name)
+      return nullptr;
+    return &*it;
+  }
+
+  GLint Program::Find(const std::string& name, GLenum type) const
+  {
+    //Inactive uniforms are expected, the compiler strips anything unused
+    const UniformInfo* pInfo = Lookup(name);
+    if(!pInfo)
+      return -1;
+
+    //Booleans are set through integers
+    if(pInfo->type != type && !(pInfo->type == GL_BOOL && type == GL_INT))
+    {
+      std::cerr << "Uniform " << name << " set with the wrong type" << std::endl;
+      return -1;
+    }
+    return pInfo->location;
+  }
+
+}
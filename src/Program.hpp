@@ -0,0 +1,92 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include "GLState.hpp"
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace ne
+{
+  //GL type a uniform must be declared with to be set from T
+  template<typename T> struct UniformType;
+  template<> struct UniformType<float> { static const GLenum value = GL_FLOAT; };
+  template<> struct UniformType<GLint> { static const GLenum value = GL_INT; };
+  template<> struct UniformType<GLuint> { static const GLenum value = GL_UNSIGNED_INT; };
+  template<> struct UniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+  template<> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+  template<> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+  inline void SetUniform(GLint loc, const float* v, GLsizei n) { glUniform1fv(loc, n, v); }
+  inline void SetUniform(GLint loc, const GLint* v, GLsizei n) { glUniform1iv(loc, n, v); }
+  inline void SetUniform(GLint loc, const GLuint* v, GLsizei n) { glUniform1uiv(loc, n, v); }
+  inline void SetUniform(GLint loc, const glm::vec2* v, GLsizei n) { glUniform2fv(loc, n, &v[0].x); }
+  inline void SetUniform(GLint loc, const glm::vec3* v, GLsizei n) { glUniform3fv(loc, n, &v[0].x); }
+  inline void SetUniform(GLint loc, const glm::mat4* v, GLsizei n) { glUniformMatrix4fv(loc, n, GL_FALSE, &v[0][0][0]); }
+
+  //Location of a uniform in the program that is currently in use. Handles
+  //that were never found ignore sets, the same as location -1 does.
+  template<typename T>
+  class Uniform
+  {
+  public:
+    Uniform() : m_location(-1) {}
+    explicit Uniform(GLint location) : m_location(location) {}
+
+    void Set(const T& value) const { SetUniform(m_location, &value, 1); }
+    void Set(const T* values, GLsizei count) const { SetUniform(m_location, values, count); }
+
+  private:
+    GLint m_location;
+  };
+
+  //A linked program whose active uniforms are reflected once, so passes hold
+  //typed handles instead of asking the driver for locations by name each frame
+  class Program
+  {
+  public:
+    Program();
+    explicit Program(GLuint program); //Takes ownership of a linked program
+    Program(Program&& other);
+    Program& operator=(Program&& other);
+    ~Program();
+
+    explicit operator bool() const { return m_program != 0; }
+    GLuint Id() const { return m_program; }
+    void Use() const { GLState::Current().UseProgram(m_program); }
+
+    //An invalid handle if the uniform is inactive, or declared with another type
+    template<typename T>
+    Uniform<T> Get(const std::string& name) const
+    {
+      return Uniform<T>(Find(name, UniformType<T>::value));
+    }
+
+    //Point samplers at texture units counting up from 0, in the order given
+    void SetSamplers(std::initializer_list<const char*> names) const;
+    //Attach a uniform block to a buffer binding point, if the program declares it
+    void SetBlock(const char* name, GLuint binding) const;
+
+  private:
+    struct UniformInfo
+    {
+      std::string name; //Arrays are stored without their [0]
+      GLint location;
+      GLenum type;
+      GLint size;
+    };
+
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    void Reflect();
+    const UniformInfo* Lookup(const std::string& name) const;
+    GLint Find(const std::string& name, GLenum type) const;
+
+    GLuint m_program;
+    std::vector<UniformInfo> m_uniforms; //Sorted by name
+  };
+}
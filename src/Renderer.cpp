@@ -5,49 +5,192 @@
 #include "Material.hpp"
 #include "Texture.hpp"
 #include "Loader.hpp"
+#include "Frustum.hpp"
+#include "GeometryArena.hpp"
+#include "TextureArrays.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
 
 #include <iostream>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <iterator>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
 
+#include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace
 {
-  GLuint GenerateBuffer(GLint format, GLint component, GLint attachment, GLsizei width, GLsizei height)
+  GLuint GenerateBuffer(GLint format, GLint component, GLint attachment, GLsizei width, GLsizei height, GLenum type = GL_FLOAT)
   {
     GLuint buf;
     glGenTextures(1, &buf);
-    glBindTexture(GL_TEXTURE_2D, buf);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, component, GL_FLOAT, NULL);
+    ne::GLState::Current().BindTexture(0, GL_TEXTURE_2D, buf);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, component, type, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, buf, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    ne::GLState::Current().BindTexture(0, GL_TEXTURE_2D, 0);
     return buf;
   }
 
-  const int MAX_BONES = 32;
+  //Must match BONES_PER_ROW in bones.glsl, each bone is three texels wide
+  const int BONES_PER_ROW = 512;
+
+  //First of the four locations taken by the per instance matrix in mesh_vert and the static shadow shaders
+  const GLuint INSTANCE_MATRIX_LOCATION = 3;
+  //Per instance material index in mesh_vert, or cube face in cubeshadows_vert
+  const GLuint INSTANCE_MATERIAL_LOCATION = 7;
+
+  //Must match MAX_MATERIALS in mesh_frag and animmesh_frag
+  const size_t MAX_MATERIALS = 1024;
+  //Uniform buffer bindings, fixed for every program
+  const GLuint MATERIAL_BLOCK_BINDING = 0;
+  const GLuint FRAME_BLOCK_BINDING = 1;
+  const GLuint LIGHT_BLOCK_BINDING = 2;
+
+  //Radiance below which a light is considered to have no effect
+  const float LIGHT_CUTOFF = 0.01f;
+  //Light volume meshes are polygons inscribed in their ideal shapes, so grow them a little
+  const float LIGHT_VOLUME_PADDING = 1.05f;
+  //Must match TILE_SIZE in tiledlight_comp.glsl. Each tile shades at most MAX_TILE_LIGHTS (256) of
+  //the lights touching it, any further ones are left out of that tile rather than overflowing it.
+  const int LIGHT_TILE_SIZE = 16;
+  //Must match local_size in hiz_comp.glsl and occlusion_comp.glsl
+  const int HIZ_GROUP_SIZE = 8;
+  const int OCCLUSION_GROUP_SIZE = 64;
+  //Animated meshes with at least this many triangles draw conditionally on a bounding box query
+  const int OCCLUSION_QUERY_MIN_TRIANGLES = 5000;
+
+  const float VIEW_FIELD_OF_VIEW = 65.0f; //Vertical, in degrees
+  const float VIEW_NEAR_PLANE = 0.1f;
+  const float VIEW_FAR_PLANE = 100.0f;
+
+  //Room for one frame's dynamic data in the stream buffer, it grows if a frame needs more
+  const size_t STREAM_FRAME_SIZE = 4 << 20;
+  //Point and spot light shadow maps
+  const float SHADOW_NEAR_PLANE = 0.1f;
+  //Each shadowed light gets a power of two resolution between these from how big it is on screen
+  const GLsizei MIN_SHADOW_SIZE = 128;
+  const GLsizei MAX_SHADOW_SIZE = 2048;
+  //Spot light maps are packed into one atlas, and point lights take six layers each of
+  //one array, drawing into a corner of each layer. Lights that don't fit go unshadowed.
+  const GLsizei SHADOW_ATLAS_SIZE = 4096;
+  const GLsizei SHADOW_LAYER_SIZE = 1024;
+  const int MAX_POINT_SHADOWS = 4;
+  //Static caster maps kept for lights that stay put, each cube is six spot maps' worth
+  const size_t MAX_CACHED_SPOT_SHADOWS = 8;
+  const size_t MAX_CACHED_POINT_SHADOWS = 4;
+
+  //Program part of a draw's sort key
+  enum sortPrograms {
+    sort_program_static_mesh,
+    sort_program_animated_mesh,
+    sort_program_shadows,
+    sort_program_anim_shadows,
+    sort_program_cube_shadows,
+    sort_program_anim_cube_shadows,
+  };
+
+  float CalcLightRadius(float radius, const glm::vec3& color, float brightness)
+  {
+    if(radius > 0.0f)
+      return radius;
 
-  enum queryTimers {
-    time_start_all,
-    time_start_all_prev,
+    //Distance at which inverse square falloff drops the brightest channel below the cutoff
+    const float maxColor = glm::max(color.x, glm::max(color.y, color.z));
+    return glm::sqrt(brightness * maxColor / LIGHT_CUTOFF);
+  }
 
-    time_start_light_pass,
-    time_start_light_pass_prev,
+  //Cell of a square grid at a position along the Z order curve
+  glm::ivec2 MortonDecode(uint32_t code)
+  {
+    glm::ivec2 cell(0);
+    for(int bit = 0; bit < 16; ++bit)
+    {
+      cell.x |= ((code >> (2 * bit)) & 1) << bit;
+      cell.y |= ((code >> (2 * bit + 1)) & 1) << bit;
+    }
+    return cell;
+  }
 
-    time_start_composite_pass,
-    time_start_composite_pass_prev,
+  size_t AlignUp(size_t offset, size_t alignment)
+  {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
 
-    time_start_debug_pass,
-    time_start_debug_pass_prev,
+  bool HasExtension(const char* name)
+  {
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for(GLint i = 0; i < numExtensions; ++i)
+    {
+      if(std::strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), name) == 0)
+        return true;
+    }
+    return false;
+  }
 
-    time_end_all,
-    time_end_all_prev,
-  };
+  //Repeat each caster once for every cube face whose frustum it touches, noting the face alongside
+  void SplitCubeFaces(const glm::mat4 (&faceTransforms)[6], const ne::CullingBatch& bounds,
+      std::vector<uint32_t>& casters, std::vector<uint32_t>& outFaces)
+  {
+    ne::Frustum frusta[6];
+    for(int face = 0; face < 6; ++face)
+      frusta[face] = ne::Frustum(faceTransforms[face]);
+
+    //The split copies go after the originals, which are dropped at the end
+    const size_t numCasters = casters.size();
+    outFaces.clear();
+    for(size_t i = 0; i < numCasters; ++i)
+    {
+      const uint32_t index = casters[i];
+      const glm::vec3 center = bounds.Center(index), extent = bounds.Extent(index);
+      for(uint32_t face = 0; face < 6; ++face)
+      {
+        if(!frusta[face].TestBox(center, extent))
+          continue;
+        casters.push_back(index);
+        outFaces.push_back(face);
+      }
+    }
+    casters.erase(casters.begin(), casters.begin() + numCasters);
+  }
+
+  //Read a shader, pasting in the files it names with #include "file" relative to itself
+  bool ReadShaderSource(const std::string& path, std::string& outSource)
+  {
+    std::ifstream is(path, std::ios::in);
+    if(!is.is_open())
+      return false;
+
+    const std::string directive = "#include \"";
+    const std::string dir = path.substr(0, path.find_last_of('/') + 1);
+    std::string line;
+    while(std::getline(is, line))
+    {
+      if(line.compare(0, directive.size(), directive) != 0)
+      {
+        outSource += line;
+        outSource += '\n';
+        continue;
+      }
+
+      const std::string includePath = dir + line.substr(directive.size(), line.find('"', directive.size()) - directive.size());
+      if(!ReadShaderSource(includePath, outSource))
+      {
+        std::cerr << "Could not open included shader: " << includePath << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
 }
 
 namespace ne
@@ -56,106 +199,124 @@ namespace ne
   Renderer::Renderer() :
     m_bIsInit(false),
     m_bIsMidFrame(false),
+    m_bTiledLighting(false),
+    m_bMultiDraw(false),
+    m_bShadowCache(false),
+    m_bCopyImage(false),
+    m_bVertexLayer(false),
+    m_bOcclusionCulling(false),
+    m_bDepthPrePass(false),
+    m_bCompactGBuffer(false),
+    m_occlusionQueryTarget(GL_ANY_SAMPLES_PASSED),
+    m_state(GLState::Current()),
     m_width(0), m_height(0),
-    m_shadowMapSize(1024),
+    m_outputFBO(0),
+    m_shadowFormat(GL_DEPTH_COMPONENT24),
     m_curTime(0),
     m_viewYaw(0),
     m_viewTilt(0),
     m_gamma(2.2),
     m_exposure(1.0),
-    m_shdStaticMesh(0),
-    m_shdAnimatedMesh(0),
-    m_shdPointLight(0),
-    m_shdDirectionalLight(0),
-    m_shdSpotLight(0),
-    m_shdGlobalIllum(0),
-    m_shdDebug(0),
-    m_shdShadows(0),
-    m_shdCubeShadows(0),
-    m_shdAnimShadows(0),
-    m_shdAnimCubeShadows(0),
-    m_shdCompositor(0),
     m_texLambert(0),
     m_texNormal(0),
     m_texPBRMaps(0),
     m_texDepth(0),
     m_texComposite(0),
+    m_texCompositeDepth(0),
     m_FBO(0),
     m_shadowFBO(0),
     m_shadowCubeFBO(0),
+    m_shadowFaceFBO(0),
     m_compositeFBO(0),
-    m_texShadow(0),
-    m_texShadowCube(0),
-    m_qryTimers{0,0,0,0,0,0,0,0,0,0},
-    m_qryShadows{0,0},
-    m_shadowTime(0),
+    m_texShadowAtlas(0),
+    m_texShadowCubes(0),
+    m_numSpotShadows(0),
+    m_numPointShadows(0),
+    m_texHiZ(0),
+    m_hiZWidth(0),
+    m_hiZHeight(0),
+    m_hiZMips(0),
+    m_bHiZDrawn(false),
+    m_occlusionBuffer(0),
+    m_occlusionBufferSize(0),
+    m_occlusionRanges(),
+    m_texBonePalette(0),
+    m_bonePaletteRows(0),
+    m_uniformAlignment(1),
+    m_storageAlignment(1),
+    m_lightBlockStride(0),
+    m_lightBlocksBuffer(0),
+    m_lightBlocksOffset(0),
+    m_instanceOffset(0),
+    m_staticCommandsOffset(0),
+    m_staticDrawsBuffer(0),
     m_pPlane(nullptr),
     m_pCube(nullptr),
     m_pSphere(nullptr),
+    m_pCone(nullptr),
     m_pDefaultLambert(nullptr),
     m_pDefaultNormal(nullptr),
     m_pDefaultMetallic(nullptr),
-    m_pDefaultRoughness(nullptr)
+    m_pDefaultRoughness(nullptr),
+    m_meshesDrawn(0),
+    m_meshesCulled(0),
+    m_meshesQueried(0),
+    m_shadowCastersDrawn(0),
+    m_shadowMapsCached(0),
+    m_shadowTexels(0),
+    m_tiledLightsDrawn(0),
+    m_stateChangesSaved(0),
+    m_drawCalls(0),
+    m_stateFiltered(0)
   {};
 
   Renderer::~Renderer()
   {
-    if(m_shdStaticMesh)
-      glDeleteProgram(m_shdStaticMesh);
-    if(m_shdAnimatedMesh)
-      glDeleteProgram(m_shdAnimatedMesh);
-    if(m_shdPointLight)
-      glDeleteProgram(m_shdPointLight);
-    if(m_shdDirectionalLight)
-      glDeleteProgram(m_shdDirectionalLight);
-    if(m_shdSpotLight)
-      glDeleteProgram(m_shdSpotLight);
-    if(m_shdGlobalIllum)
-      glDeleteProgram(m_shdGlobalIllum);
-    if(m_shdDebug)
-      glDeleteProgram(m_shdDebug);
-    if(m_shdShadows)
-      glDeleteProgram(m_shdShadows);
-    if(m_shdCubeShadows)
-      glDeleteProgram(m_shdCubeShadows);
-    if(m_shdAnimShadows)
-      glDeleteProgram(m_shdAnimShadows);
-    if(m_shdAnimCubeShadows)
-      glDeleteProgram(m_shdAnimCubeShadows);
-    if(m_shdCompositor)
-      glDeleteProgram(m_shdCompositor);
     if(m_texLambert)
-      glDeleteTextures(1, &m_texLambert);
+      m_state.DeleteTextures(1, &m_texLambert);
     if(m_texNormal)
-      glDeleteTextures(1, &m_texNormal);
+      m_state.DeleteTextures(1, &m_texNormal);
     if(m_texPBRMaps)
-      glDeleteTextures(1, &m_texPBRMaps);
+      m_state.DeleteTextures(1, &m_texPBRMaps);
     if(m_texDepth)
-      glDeleteTextures(1, &m_texDepth);
+      m_state.DeleteTextures(1, &m_texDepth);
     if(m_texComposite)
-      glDeleteTextures(1, &m_texComposite);
+      m_state.DeleteTextures(1, &m_texComposite);
+    if(m_texCompositeDepth)
+      m_state.DeleteTextures(1, &m_texCompositeDepth);
     if(m_FBO)
-      glDeleteFramebuffers(1, &m_FBO);
+      m_state.DeleteFramebuffers(1, &m_FBO);
     if(m_shadowFBO)
-      glDeleteFramebuffers(1, &m_shadowFBO);
+      m_state.DeleteFramebuffers(1, &m_shadowFBO);
     if(m_shadowCubeFBO)
-      glDeleteFramebuffers(1, &m_shadowCubeFBO);
+      m_state.DeleteFramebuffers(1, &m_shadowCubeFBO);
+    if(m_shadowFaceFBO)
+      m_state.DeleteFramebuffers(1, &m_shadowFaceFBO);
     if(m_compositeFBO)
-      glDeleteFramebuffers(1, &m_compositeFBO);
-    if(m_texShadow)
-      glDeleteTextures(1, &m_texShadow);
-    if(m_texShadowCube)
-      glDeleteTextures(1, &m_texShadowCube);
-    if(m_qryTimers[0])
-      glDeleteQueries(sizeof(m_qryTimers) / sizeof(GLuint), m_qryTimers);
-    if(m_qryShadows)
-      glDeleteQueries(2, m_qryShadows);
+      m_state.DeleteFramebuffers(1, &m_compositeFBO);
+    if(m_texShadowAtlas)
+      m_state.DeleteTextures(1, &m_texShadowAtlas);
+    if(m_texShadowCubes)
+      m_state.DeleteTextures(1, &m_texShadowCubes);
+    if(m_texHiZ)
+      m_state.DeleteTextures(1, &m_texHiZ);
+    if(m_occlusionBuffer)
+      glDeleteBuffers(1, &m_occlusionBuffer);
+    if(m_texBonePalette)
+      m_state.DeleteTextures(1, &m_texBonePalette);
+    for(const MeshQuery& query : m_meshQueries)
+    {
+      if(query.query)
+        glDeleteQueries(1, &query.query);
+    }
     if(m_pPlane)
       delete m_pPlane;
     if(m_pCube)
       delete m_pCube;
     if(m_pSphere)
       delete m_pSphere;
+    if(m_pCone)
+      delete m_pCone;
     if(m_pDefaultLambert)
       delete m_pDefaultLambert;
     if(m_pDefaultNormal)
@@ -173,110 +334,70 @@ namespace ne
 
     //Construct a frame buffer
     glGenFramebuffers(1, &m_FBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
-
-    m_texLambert = GenerateBuffer(GL_RGB8, GL_RGB, GL_COLOR_ATTACHMENT0, m_width, m_height);
-    m_texNormal = GenerateBuffer(GL_RGB16F, GL_RGB, GL_COLOR_ATTACHMENT1, m_width, m_height);
-    m_texPBRMaps = GenerateBuffer(GL_RG16F, GL_RG, GL_COLOR_ATTACHMENT2, m_width, m_height);
-    m_texDepth = GenerateBuffer(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_DEPTH_ATTACHMENT, m_width, m_height);
-
-    GLenum drawBuffers[] = {
-      GL_COLOR_ATTACHMENT0,
-      GL_COLOR_ATTACHMENT1,
-      GL_COLOR_ATTACHMENT2
-    };
-    glDrawBuffers(sizeof drawBuffers / sizeof drawBuffers[0], drawBuffers);
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
 
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-      return false;
+    //Alpha carries metallic in the compact layout
+    m_texLambert = GenerateBuffer(GL_RGBA8, GL_RGBA, GL_COLOR_ATTACHMENT0, m_width, m_height, GL_UNSIGNED_BYTE);
+    m_texDepth = GenerateBuffer(GL_DEPTH32F_STENCIL8, GL_DEPTH_STENCIL, GL_DEPTH_STENCIL_ATTACHMENT, m_width, m_height, GL_FLOAT_32_UNSIGNED_INT_24_8_REV);
 
 
     //Setup framebuffer for compositing
     glGenFramebuffers(1, &m_compositeFBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_compositeFBO);
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_compositeFBO);
 
-    m_texComposite = GenerateBuffer(GL_RGB16F, GL_RGB, GL_COLOR_ATTACHMENT0, m_width, m_height);
-    GLenum compositeBuffers[] = {
-      GL_COLOR_ATTACHMENT0,
-    };
-    glDrawBuffers(sizeof compositeBuffers / sizeof compositeBuffers[0], compositeBuffers);
+    //Same format as m_texDepth so the geometry depth can be blitted across
+    m_texCompositeDepth = GenerateBuffer(GL_DEPTH32F_STENCIL8, GL_DEPTH_STENCIL, GL_DEPTH_STENCIL_ATTACHMENT, m_width, m_height, GL_FLOAT_32_UNSIGNED_INT_24_8_REV);
 
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    //The rest of both framebuffers depends on the layout, and is remade when it changes
+    if(!CreateGBuffer())
       return false;
 
-
-    //Return to default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    //Setup frame buffer for shadows
-    glGenTextures(1, &m_texShadow);
-    glBindTexture(GL_TEXTURE_2D, m_texShadow);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0, GL_DEPTH_COMPONENT,
-        m_shadowMapSize,
-        m_shadowMapSize,
-        0,
-        GL_DEPTH_COMPONENT,
-        GL_FLOAT,
-        NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    GLfloat borderColor[] = { 0.0, 0.0, 0.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
+    //Shadow map targets, their textures are remade whenever the depth format changes
     glGenFramebuffers(1, &m_shadowFBO);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, m_shadowFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_texShadow, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-
-    //Return to default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    //Setup frame buffer for shadows
-    glGenTextures(1, &m_texShadowCube);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texShadowCube);
-    for(int i = 0; i < 6; ++i)
-    {
-      glTexImage2D(
-          GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-          0, GL_DEPTH_COMPONENT,
-          m_shadowMapSize,
-          m_shadowMapSize,
-          0,
-          GL_DEPTH_COMPONENT,
-          GL_FLOAT,
-          NULL);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-    glTexParameterfv(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BORDER_COLOR, borderColor);
-
     glGenFramebuffers(1, &m_shadowCubeFBO);
+    CreateShadowMaps();
 
-    glBindFramebuffer(GL_FRAMEBUFFER, m_shadowCubeFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texShadowCube, 0);
+    //Cube faces are attached to this one at a time as they are drawn
+    glGenFramebuffers(1, &m_shadowFaceFBO);
+
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, m_shadowFaceFBO);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
 
     //Return to default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    //Skinning matrices for the frame, fetched by texel so it is never filtered
+    glGenTextures(1, &m_texBonePalette);
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texBonePalette);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, BONES_PER_ROW * 3, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+    m_state.BindTexture(0, GL_TEXTURE_2D, 0);
+    m_bonePaletteRows = 1;
 
     glClearDepth(1.0);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    m_state.DepthFunc(GL_LESS);
+    m_state.Enable(GL_DEPTH_TEST);
+    m_state.Enable(GL_CULL_FACE);
+    m_state.CullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
 
+    //Compute shaders and multi-draw indirect both arrived in 4.3
+    GLint glMajor = 0, glMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &glMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &glMinor);
+    const bool bHasGL43 = glMajor > 4 || (glMajor == 4 && glMinor >= 3);
+    //Persistent mapping arrived in 4.4
+    const bool bHasGL44 = glMajor > 4 || (glMajor == 4 && glMinor >= 4);
+    //The compute shaders are GLSL ES 3.10, which desktop GL only builds from 4.5 or with ES 3.1 compatibility
+    const bool bHasES31 = glMajor > 4 || (glMajor == 4 && glMinor >= 5) || HasExtension("GL_ARB_ES3_1_compatibility");
+
+    //Without gl_Layer in the vertex shader a cube's faces are drawn as separate passes.
+    //cubeshadows_vert checks for the same extensions, so it agrees with the choice.
+    m_bVertexLayer = HasExtension("GL_ARB_shader_viewport_layer_array") || HasExtension("GL_AMD_vertex_shader_layer");
+
     m_shdStaticMesh = LoadShader("shaders/mesh_vert.glsl", "shaders/mesh_frag.glsl");
     if(!m_shdStaticMesh)
       return false;
@@ -285,7 +406,15 @@ namespace ne
     if(!m_shdAnimatedMesh)
       return false;
 
-    m_shdPointLight = LoadShader("shaders/light_vert.glsl", "shaders/pointlight_frag.glsl");
+    m_shdDepth = LoadShader("shaders/depth_vert.glsl", "shaders/shadows_frag.glsl");
+    if(!m_shdDepth)
+      return false;
+
+    m_shdAnimDepth = LoadShader("shaders/anim_depth_vert.glsl", "shaders/shadows_frag.glsl");
+    if(!m_shdAnimDepth)
+      return false;
+
+    m_shdPointLight = LoadShader("shaders/lightvolume_vert.glsl", "shaders/pointlight_frag.glsl");
     if(!m_shdPointLight)
       return false;
 
@@ -293,10 +422,26 @@ namespace ne
     if(!m_shdDirectionalLight)
       return false;
 
-    m_shdSpotLight = LoadShader("shaders/spotlight_vert.glsl", "shaders/spotlight_frag.glsl");
+    m_shdSpotLight = LoadShader("shaders/lightvolume_vert.glsl", "shaders/spotlight_frag.glsl");
     if(!m_shdSpotLight)
       return false;
 
+    m_shdLightStencil = LoadShader("shaders/lightvolume_vert.glsl", "shaders/lightstencil_frag.glsl");
+    if(!m_shdLightStencil)
+      return false;
+
+    //Tiled lighting needs compute shaders, without them every light takes the volume path.
+    //A driver that fails to build them falls back the same way rather than failing Init.
+    if(bHasGL43 && bHasES31)
+    {
+      m_shdTiledLights = LoadComputeShader("shaders/tiledlight_comp.glsl");
+      m_bTiledLighting = bool(m_shdTiledLights);
+
+      m_shdHiZ = LoadComputeShader("shaders/hiz_comp.glsl");
+      m_shdOcclusion = LoadComputeShader("shaders/occlusion_comp.glsl");
+      m_bOcclusionCulling = m_shdHiZ && m_shdOcclusion;
+    }
+
     m_shdGlobalIllum = LoadShader("shaders/globalillum_vert.glsl", "shaders/globalillum_frag.glsl");
     if(!m_shdGlobalIllum)
       return false;
@@ -309,7 +454,7 @@ namespace ne
     if(!m_shdShadows)
       return false;
 
-    m_shdCubeShadows = LoadShader("shaders/static_shadows_vert.glsl", "shaders/cubeshadows_frag.glsl", "shaders/cubeshadows_geom.glsl");
+    m_shdCubeShadows = LoadShader("shaders/cubeshadows_vert.glsl", "shaders/cubeshadows_frag.glsl");
     if(!m_shdCubeShadows)
       return false;
 
@@ -317,7 +462,7 @@ namespace ne
     if(!m_shdAnimShadows)
       return false;
 
-    m_shdAnimCubeShadows = LoadShader("shaders/anim_shadows_vert.glsl", "shaders/cubeshadows_frag.glsl", "shaders/cubeshadows_geom.glsl");
+    m_shdAnimCubeShadows = LoadShader("shaders/anim_cubeshadows_vert.glsl", "shaders/cubeshadows_frag.glsl");
     if(!m_shdAnimCubeShadows)
       return false;
 
@@ -325,6 +470,102 @@ namespace ne
     if(!m_shdCompositor)
       return false;
 
+    //Blocks shared between programs sit at the same binding in all of them
+    const Program* programs[] = {
+      &m_shdStaticMesh, &m_shdAnimatedMesh, &m_shdDepth, &m_shdAnimDepth, &m_shdPointLight, &m_shdDirectionalLight, &m_shdSpotLight,
+      &m_shdLightStencil, &m_shdTiledLights, &m_shdGlobalIllum, &m_shdDebug, &m_shdShadows,
+      &m_shdCubeShadows, &m_shdAnimShadows, &m_shdAnimCubeShadows, &m_shdCompositor
+    };
+    for(const Program* pProgram : programs)
+    {
+      pProgram->SetBlock("Materials", MATERIAL_BLOCK_BINDING);
+      pProgram->SetBlock("Frame", FRAME_BLOCK_BINDING);
+      pProgram->SetBlock("Light", LIGHT_BLOCK_BINDING);
+    }
+
+    //Passes set uniforms through these handles rather than looking them up each frame
+    m_uniStaticMesh.Find(m_shdStaticMesh);
+    m_uniAnimatedMesh.Find(m_shdAnimatedMesh);
+    m_uniAnimDepth.Find(m_shdAnimDepth);
+    m_uniDebug.Find(m_shdDebug);
+    m_uniTiledLights.Find(m_shdTiledLights);
+    m_uniShadows.Find(m_shdShadows);
+    m_uniAnimShadows.Find(m_shdAnimShadows);
+    m_uniCubeShadows.Find(m_shdCubeShadows);
+    m_uniAnimCubeShadows.Find(m_shdAnimCubeShadows);
+    m_uniGlobalIllum.Find(m_shdGlobalIllum);
+    m_uniCompositor.Find(m_shdCompositor);
+    m_uniHiZ.Find(m_shdHiZ);
+    m_uniOcclusion.Find(m_shdOcclusion);
+
+    //Each pass binds its textures to the same units every time
+    m_shdStaticMesh.SetSamplers({"sampLambert", "sampNormal", "sampMetallic", "sampRoughness"});
+    m_shdAnimatedMesh.SetSamplers({"sampLambert", "sampNormal", "sampMetallic", "sampRoughness", "sampBones"});
+    m_shdPointLight.SetSamplers({"sampLambert", "sampNormal", "sampPBRMaps", "sampDepth", "sampShadow"});
+    m_shdDirectionalLight.SetSamplers({"sampLambert", "sampNormal", "sampPBRMaps", "sampDepth"});
+    m_shdSpotLight.SetSamplers({"sampLambert", "sampNormal", "sampPBRMaps", "sampDepth", "sampShadow"});
+    m_shdTiledLights.SetSamplers({"sampLambert", "sampNormal", "sampDepth"});
+    m_shdGlobalIllum.SetSamplers({"sampColor"});
+    m_shdCompositor.SetSamplers({"sampBuffer", "sampDepth"});
+    m_shdHiZ.SetSamplers({"sampDepth"});
+    m_shdOcclusion.SetSamplers({"sampHiZ"});
+    m_shdAnimShadows.SetSamplers({"sampBones"});
+    m_shdAnimDepth.SetSamplers({"", "", "", "", "sampBones"}); //Shares DrawAnimatedMeshes, so the same units as m_shdAnimatedMesh
+    m_shdAnimCubeShadows.SetSamplers({"sampBones"});
+
+    //Everything uploaded per frame is written into one ring and bound by offset
+    if(!m_stream.Init(STREAM_FRAME_SIZE, bHasGL44))
+      return false;
+
+    //Ranges bound as uniform or storage blocks must start on these
+    GLint uniformAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    m_uniformAlignment = std::max<size_t>(uniformAlignment, 16);
+    if(bHasGL43)
+    {
+      GLint storageAlignment = 0;
+      glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+      m_storageAlignment = std::max<size_t>(storageAlignment, 16);
+    }
+
+    //Each light's block is bound as a range of one buffer, so they start on aligned offsets
+    m_lightBlockStride = (sizeof(LightBlock) + m_uniformAlignment - 1) / m_uniformAlignment * m_uniformAlignment;
+
+    //Without multi-draw each indirect command is issued on its own
+    m_bMultiDraw = bHasGL43;
+
+    //Cached maps are copied out with glCopyImageSubData, also from 4.3
+    m_bCopyImage = bHasGL43;
+    m_bShadowCache = m_bCopyImage;
+
+    //Conservative occlusion queries are 4.3 too, the exact kind works the same only slower
+    m_occlusionQueryTarget = bHasGL43 ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+
+    //Depth pyramid for occlusion culling, power of two sized so every level halves evenly
+    if(m_bOcclusionCulling)
+    {
+      m_hiZWidth = 1;
+      while(m_hiZWidth * 2 <= m_width)
+        m_hiZWidth *= 2;
+      m_hiZHeight = 1;
+      while(m_hiZHeight * 2 <= m_height)
+        m_hiZHeight *= 2;
+      m_hiZMips = 1;
+      while((std::max(m_hiZWidth, m_hiZHeight) >> m_hiZMips) > 0)
+        ++m_hiZMips;
+
+      glGenTextures(1, &m_texHiZ);
+      m_state.BindTexture(0, GL_TEXTURE_2D, m_texHiZ);
+      glTexStorage2D(GL_TEXTURE_2D, m_hiZMips, GL_R32F, m_hiZWidth, m_hiZHeight);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      m_state.BindTexture(0, GL_TEXTURE_2D, 0);
+
+      glGenBuffers(1, &m_occlusionBuffer);
+    }
+
     m_pPlane = Loader::GeneratePlane();
     if(!m_pPlane)
       return false;
@@ -337,6 +578,10 @@ namespace ne
     if(!m_pSphere)
       return false;
 
+    m_pCone = Loader::GenerateCone();
+    if(!m_pCone)
+      return false;
+
     m_pDefaultLambert = Loader::GeneratePurpleCheques();
     if(!m_pDefaultLambert)
       return false;
@@ -353,15 +598,8 @@ namespace ne
     if(!m_pDefaultRoughness)
       return false;
 
-    const size_t numTimers = sizeof(m_qryTimers) / sizeof(GLuint);
-    glGenQueries(numTimers, m_qryTimers);
-    glGenQueries(2, m_qryShadows);
-
-    //Set some initial values to be pulled
-    for(size_t i = 0; i < numTimers; ++i)
-      glQueryCounter(m_qryTimers[i], GL_TIMESTAMP);
-    glQueryCounter(m_qryShadows[0], GL_TIMESTAMP);
-    glQueryCounter(m_qryShadows[1], GL_TIMESTAMP);
+    //Scratch for every thread the job system records commands on
+    m_recordScratch.resize(m_jobs.NumThreads());
 
     m_bIsInit = true;
     return true;
@@ -370,83 +608,170 @@ namespace ne
   void Renderer::BeginFrame()
   {
     m_bIsMidFrame = true;
+    m_stream.BeginFrame();
+    m_shadowCache.NextFrame();
+
     //Clear out existing lights and geometry
     m_staticMeshes.clear();
     m_animatedMeshes.clear();
+    m_bonePalette.clear();
+    m_staticBounds.Clear();
+    m_animatedBounds.Clear();
     m_pointLights.clear();
     m_directionalLights.clear();
     m_spotLights.clear();
     m_debugCubes.clear();
     m_debugSpheres.clear();
+    m_materialIds.clear();
+    m_materialLayers.clear();
+    m_materialTextureSets.clear();
+    m_textureSets.clear();
+    m_meshIds.clear();
+
+    //The default material always takes id 0
+    MaterialId(nullptr);
   }
 
   void Renderer::EndFrame()
   {
-    glQueryCounter(m_qryTimers[time_start_all], GL_TIMESTAMP);
+    NE_PROFILE_ZONE("Renderer::EndFrame");
+
+    //Traces line every finished frame up against the CPU zones that issued it
+    if(m_timers.BeginFrame())
+      Profiler::Instance().AddGpuFrame(m_timers.LastFrame());
+
+    PrepareFrame();
+    SubmitFrame();
+
+    m_bIsMidFrame = false;
+  }
+
+  void Renderer::PrepareFrame()
+  {
+    NE_PROFILE_ZONE("Renderer::PrepareFrame");
+
+    //Throw away anything the camera can't see
+    CullGeometry();
+
+    //Shadow maps are handed out here, before any job goes looking for them
+    BuildLightBlocks();
+
+    //Nothing so far has touched GL, and the jobs don't either
+    RecordCommands();
+  }
+
+  void Renderer::SubmitFrame()
+  {
+    NE_PROFILE_ZONE("Renderer::SubmitFrame");
+    m_timers.Begin("Frame");
+    const size_t filteredBefore = m_state.Filtered();
+
+    //Textures loaded since the last frame get their mips, an array at a time
+    TextureArrays::Static().UpdateMipmaps();
+
+    //Every visible material has an id now, send their layers over
+    UploadMaterials();
+
+    //Constants every pass reads, sent once rather than to each program
+    UploadFrameConstants();
+    UploadLights();
+    UploadBonePalette();
 
     //Prepare for geometry pass
     SetupGeometryPass();
 
+    //Lay the depth down first so the g buffers are only written once per pixel
+    if(m_bDepthPrePass)
+    {
+      m_timers.Begin("Depth Pre-Pass");
+      SetupDepthPrePass();
+      DrawStaticMeshes(true);
+      DrawAnimatedMeshes(true);
+      m_timers.End();
+    }
+
     //Draw the geometry into the g buffers
-    DrawStaticMeshes();
-    DrawAnimatedMeshes();
+    m_timers.Begin("Geometry");
+    if(m_bDepthPrePass)
+    {
+      SetupGBufferPass();
+      RedrawStaticMeshes();
+    }
+    else
+    {
+      DrawStaticMeshes(false);
+    }
+    DrawAnimatedMeshes(false);
+
+    //Test heavy meshes' boxes against the finished depth, their draws next frame wait on the results
+    DrawOcclusionQueries();
+    m_timers.End();
 
-    glQueryCounter(m_qryTimers[time_start_light_pass], GL_TIMESTAMP);
+    //Every light's shadow map goes in before any lighting reads them
+    m_timers.Begin("Shadows");
+    DrawShadowMaps();
+    m_timers.End();
 
     //Prepare for lighting pass
+    m_timers.Begin("Lighting");
     SetupLightPass();
 
+    //Overwrites the composite buffer, so it goes before anything blends into it
+    m_timers.Begin("Tiled Lights");
+    DrawTiledPointLights();
+    m_timers.End();
+
     //Perform global illumination
+    m_timers.Begin("Global Illumination");
     ApplyGlobalIllumination();
+    m_timers.End();
 
     //Apply all our lights
-    m_shadowTime = 0.0; //Reset profiling
     DrawPointLights();
     DrawDirectionalLights();
     DrawSpotLights();
+    m_timers.End();
 
-    glQueryCounter(m_qryTimers[time_start_composite_pass], GL_TIMESTAMP);
-
+    m_timers.Begin("Composite");
     CompositeFrame();
+    m_timers.End();
 
     //TODO in future: final pass for transparent/translucent objects
 
-    glQueryCounter(m_qryTimers[time_start_debug_pass], GL_TIMESTAMP);
-
+    m_timers.Begin("Debug");
     SetupDebugPass();
     for (auto& cube : m_debugCubes)
       DrawDebugMesh(m_pCube, cube);
     for (auto& sphere : m_debugSpheres)
       DrawDebugMesh(m_pSphere, sphere);
+    m_timers.End();
 
-    glQueryCounter(m_qryTimers[time_end_all], GL_TIMESTAMP);
-
-    //Swap the query timers around
-    std::swap(m_qryTimers[time_start_all], m_qryTimers[time_start_all_prev]);
-    std::swap(m_qryTimers[time_start_light_pass], m_qryTimers[time_start_light_pass_prev]);
-    std::swap(m_qryTimers[time_start_composite_pass], m_qryTimers[time_start_composite_pass_prev]);
-    std::swap(m_qryTimers[time_start_debug_pass], m_qryTimers[time_start_debug_pass_prev]);
-    std::swap(m_qryTimers[time_end_all], m_qryTimers[time_end_all_prev]);
-
-    m_bIsMidFrame = false;
+    m_timers.End();
+    m_stateFiltered = m_state.Filtered() - filteredBefore;
   }
 
   FrameStats Renderer::LastFrameStats()
   {
+    //Times come from the newest frame the GPU has finished, a few behind the counts
     FrameStats fs;
-    GLuint64 start_all, start_light, start_comp, start_debug, end_all;
-    glGetQueryObjectui64v(m_qryTimers[time_start_all_prev], GL_QUERY_RESULT, &start_all);
-    glGetQueryObjectui64v(m_qryTimers[time_start_light_pass_prev], GL_QUERY_RESULT, &start_light);
-    glGetQueryObjectui64v(m_qryTimers[time_start_composite_pass_prev], GL_QUERY_RESULT, &start_comp);
-    glGetQueryObjectui64v(m_qryTimers[time_start_debug_pass_prev], GL_QUERY_RESULT, &start_debug);
-    glGetQueryObjectui64v(m_qryTimers[time_end_all_prev], GL_QUERY_RESULT, &end_all);
-
-    fs.totalTime = double(end_all - start_all) / 1e6;
-    fs.geometryTime = double(start_light - start_all) / 1e6;
-    fs.lightingTime = double(start_comp - start_light) / 1e6;
-    fs.compositeTime = double(start_debug - start_comp) / 1e6;
-    fs.debugTime = double(end_all - start_debug) / 1e6;
-    fs.shadowTime = m_shadowTime;
+    fs.totalTime = m_timers.Time("Frame");
+    fs.depthPrePassTime = m_timers.Time("Depth Pre-Pass");
+    fs.geometryTime = m_timers.Time("Geometry");
+    fs.lightingTime = m_timers.Time("Lighting");
+    fs.shadowTime = m_timers.Time("Shadows");
+    fs.compositeTime = m_timers.Time("Composite");
+    fs.debugTime = m_timers.Time("Debug");
+    fs.gpuScopes = m_timers.LastFrame();
+    fs.meshesDrawn = m_meshesDrawn;
+    fs.meshesCulled = m_meshesCulled;
+    fs.meshesQueried = m_meshesQueried;
+    fs.shadowCastersDrawn = m_shadowCastersDrawn;
+    fs.shadowMapsCached = m_shadowMapsCached;
+    fs.shadowTexels = m_shadowTexels;
+    fs.tiledLights = m_tiledLightsDrawn;
+    fs.stateChangesSaved = m_stateChangesSaved;
+    fs.drawCalls = m_drawCalls;
+    fs.stateFiltered = m_stateFiltered;
     return fs;
   }
 
@@ -464,7 +789,7 @@ namespace ne
 
   void Renderer::UpdateProjectionMatrix()
   {
-    glm::mat4 proj = glm::perspective(glm::radians(65.0), 16.0/9.0, 0.1, 100.0);
+    glm::mat4 proj = glm::perspective(glm::radians(VIEW_FIELD_OF_VIEW), 16.0f/9.0f, VIEW_NEAR_PLANE, VIEW_FAR_PLANE);
     glm::mat4 rot =
       glm::rotate(glm::mat4(1.0), m_viewTilt, glm::vec3(1,0,0)) *
       glm::rotate(glm::mat4(1.0), m_viewYaw, glm::vec3(0,1,0));
@@ -478,6 +803,7 @@ namespace ne
       return;
 
     m_staticMeshes.push_back(StaticMeshInstance(pMesh, pMat, matPosition));
+    m_staticBounds.Add(pMesh->m_bounds, matPosition);
   }
 
   void Renderer::AddAnimatedMesh(AnimatedMesh *pMesh, Material *pMat, glm::mat4 matPosition, const std::vector<glm::mat4> *boneTransforms)
@@ -485,413 +811,852 @@ namespace ne
     if(!pMesh || !boneTransforms || !m_bIsMidFrame)
       return;
 
-    m_animatedMeshes.push_back(AnimatedMeshInstance(pMesh, pMat, matPosition, boneTransforms));
+    //Bones are affine, so the bottom row of each transform is left behind
+    const uint32_t firstBone = m_bonePalette.size() / 3;
+    for(const glm::mat4& bone : *boneTransforms)
+    {
+      const glm::mat4 rows = glm::transpose(bone);
+      m_bonePalette.push_back(rows[0]);
+      m_bonePalette.push_back(rows[1]);
+      m_bonePalette.push_back(rows[2]);
+    }
+
+    m_animatedMeshes.push_back(AnimatedMeshInstance(pMesh, pMat, matPosition, firstBone));
+    m_animatedBounds.Add(pMesh->m_bounds, matPosition);
   }
 
-  void Renderer::DrawStaticMeshes()
+  void Renderer::CullGeometry()
   {
-    glUseProgram(m_shdStaticMesh);
-    glUniformMatrix4fv(glGetUniformLocation(m_shdStaticMesh, "matView"), 1, GL_FALSE, &m_matProjection[0][0]);
+    NE_PROFILE_ZONE("Renderer::CullGeometry");
+    const Frustum frustum(m_matProjection);
+
+    m_visibleStaticMeshes.clear();
+    m_staticBounds.CullFrustum(frustum, m_visibleStaticMeshes);
+
+    m_visibleAnimatedMeshes.clear();
+    m_animatedBounds.CullFrustum(frustum, m_visibleAnimatedMeshes);
+
+    m_meshesDrawn = m_visibleStaticMeshes.size() + m_visibleAnimatedMeshes.size();
+    m_meshesCulled = m_staticMeshes.size() + m_animatedMeshes.size() - m_meshesDrawn;
+    m_shadowCastersDrawn = 0;
+    m_shadowMapsCached = 0;
+    m_shadowTexels = 0;
+    m_stateChangesSaved = 0;
+    m_drawCalls = 0;
+
+    //Recording only reads ids, so they are all given out now. Shadows draw meshes
+    //out of view, so every mesh needs one, but only visible instances a material.
+    for(StaticMeshInstance& model : m_staticMeshes)
+      model.meshId = MeshId(model.mesh);
+    for(AnimatedMeshInstance& model : m_animatedMeshes)
+      model.meshId = MeshId(model.mesh);
+    for(uint32_t index : m_visibleStaticMeshes)
+      m_staticMeshes[index].materialId = MaterialId(m_staticMeshes[index].mat);
+    for(uint32_t index : m_visibleAnimatedMeshes)
+      m_animatedMeshes[index].materialId = MaterialId(m_animatedMeshes[index].mat);
+  }
 
-    glUniform1i(glGetUniformLocation(m_shdStaticMesh, "sampLambert"), 0);
-    glUniform1i(glGetUniformLocation(m_shdStaticMesh, "sampNormal"), 1);
-    glUniform1i(glGetUniformLocation(m_shdStaticMesh, "sampMetallic"), 2);
-    glUniform1i(glGetUniformLocation(m_shdStaticMesh, "sampRoughness"), 3);
+  void Renderer::RecordCommands()
+  {
+    NE_PROFILE_ZONE("Renderer::RecordCommands");
 
-    GLint matPosLoc = glGetUniformLocation(m_shdStaticMesh, "matPos");
-    for(auto& model : m_staticMeshes)
+    //A job for the view and one for each shadow map, every one writing only its own commands
+    size_t numShadows = 0;
+    for(size_t i = 0; i < m_pointLights.size() + m_spotLights.size(); ++i)
     {
-      glUniformMatrix4fv(matPosLoc, 1, GL_FALSE, &model.pos[0][0]);
-
-      Texture *pLambert = model.mat ? model.mat->m_pLambert : nullptr;
-      if(!pLambert)
-        pLambert = m_pDefaultLambert;
-
-      Texture *pNormal = model.mat ? model.mat->m_pNormal : nullptr;
-      if(!pNormal)
-        pNormal = m_pDefaultNormal;
-
-      Texture *pMetallic = model.mat ? model.mat->m_pMetallic : nullptr;
-      if(!pMetallic)
-        pMetallic = m_pDefaultMetallic;
-
-      Texture *pRoughness = model.mat ? model.mat->m_pRoughness : nullptr;
-      if(!pRoughness)
-        pRoughness = m_pDefaultRoughness;
+      if(!LightBlockAt(i).useShadows)
+        continue;
+
+      if(numShadows == m_shadowCommands.size())
+        m_shadowCommands.emplace_back();
+      ShadowCommands& commands = m_shadowCommands[numShadows++];
+      commands.block = i;
+      commands.bCube = i < m_pointLights.size();
+    }
+    m_shadowCommands.resize(numShadows);
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, pLambert->m_glTexture);
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, pNormal->m_glTexture);
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, pMetallic->m_glTexture);
-      glActiveTexture(GL_TEXTURE3);
-      glBindTexture(GL_TEXTURE_2D, pRoughness->m_glTexture);
+    m_jobs.ParallelFor(1 + numShadows, [this](size_t job, int thread)
+    {
+      if(job == 0)
+        RecordViewCommands();
+      else
+        RecordShadowCommands(m_shadowCommands[job - 1], m_recordScratch[thread]);
+    });
 
-      glBindVertexArray(model.mesh->m_vaoConfig);
+    //The view's batching is counted once, though a pre-pass draws it twice
+    m_stateChangesSaved += m_viewDraws.stateChangesSaved;
+  }
 
-      if(model.mesh->m_iNumIndices > 0)
-      {
-        glDrawElements(GL_TRIANGLES, model.mesh->m_iNumIndices, GL_UNSIGNED_INT, 0);
-      }
-      else
-      {
-        glDrawArrays(GL_TRIANGLES, 0, model.mesh->m_iNumTris*3);
-      }
-    }
+  void Renderer::RecordViewCommands()
+  {
+    NE_PROFILE_ZONE("Renderer::RecordViewCommands");
 
-    glBindVertexArray(0);
+    QueueDraws(m_staticQueue, draw_pass_geometry, sort_program_static_mesh, m_visibleStaticMeshes, m_staticMeshes, m_staticBounds, m_viewPos, VIEW_FAR_PLANE);
+    QueueDraws(m_animatedQueue, draw_pass_geometry, sort_program_animated_mesh, m_visibleAnimatedMeshes, m_animatedMeshes, m_animatedBounds, m_viewPos, VIEW_FAR_PLANE);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    //Batches are split by texture set even for a depth pre-pass, so the g buffer pass can repeat its draws
+    BuildStaticDraws(m_staticQueue, true, m_viewDraws);
   }
 
-  void Renderer::DrawAnimatedMeshes()
+  void Renderer::RecordShadowCommands(ShadowCommands& commands, RecordScratch& scratch) const
   {
-    glUseProgram(m_shdAnimatedMesh);
-    glUniformMatrix4fv(glGetUniformLocation(m_shdAnimatedMesh, "matView"), 1, GL_FALSE, &m_matProjection[0][0]);
-
-    glUniform1i(glGetUniformLocation(m_shdAnimatedMesh, "sampLambert"), 0);
-    glUniform1i(glGetUniformLocation(m_shdAnimatedMesh, "sampNormal"), 1);
-    glUniform1i(glGetUniformLocation(m_shdAnimatedMesh, "sampMetallic"), 2);
-    glUniform1i(glGetUniformLocation(m_shdAnimatedMesh, "sampRoughness"), 3);
+    NE_PROFILE_ZONE("Renderer::RecordShadowCommands");
+    const LightBlock& block = LightBlockAt(commands.block);
+    const glm::vec3 position = block.pos;
 
-    const GLint matPosLoc = glGetUniformLocation(m_shdAnimatedMesh, "matPos");
-    const GLint matBonesLoc = glGetUniformLocation(m_shdAnimatedMesh, "boneTransforms");
-    for(auto& model : m_animatedMeshes)
+    if(commands.bCube)
     {
-      glUniformMatrix4fv(matPosLoc, 1, GL_FALSE, &model.pos[0][0]);
-      glUniformMatrix4fv(
-          matBonesLoc,
-          model.boneTransforms->size(),
-          GL_FALSE,
-          &model.boneTransforms->data()[0][0][0]);
-
-      Texture *pLambert = model.mat ? model.mat->m_pLambert : nullptr;
-      if(!pLambert)
-        pLambert = m_pDefaultLambert;
+      const double nearPlane = block.nearPlane, farPlane = block.farPlane;
+      const glm::mat4 lightProj = glm::perspective(glm::radians(90.0), 1.0, nearPlane, farPlane);
+      commands.lightTransforms[0] = lightProj * glm::lookAt(position, position + glm::vec3( 1,0,0), glm::vec3(0,-1,0));
+      commands.lightTransforms[1] = lightProj * glm::lookAt(position, position + glm::vec3(-1,0,0), glm::vec3(0,-1,0));
+      commands.lightTransforms[2] = lightProj * glm::lookAt(position, position + glm::vec3(0, 1,0), glm::vec3(0,0, 1));
+      commands.lightTransforms[3] = lightProj * glm::lookAt(position, position + glm::vec3(0,-1,0), glm::vec3(0,0,-1));
+      commands.lightTransforms[4] = lightProj * glm::lookAt(position, position + glm::vec3(0,0, 1), glm::vec3(0,-1,0));
+      commands.lightTransforms[5] = lightProj * glm::lookAt(position, position + glm::vec3(0,0,-1), glm::vec3(0,-1,0));
+
+      //Only meshes within farPlane of the light can cast, and each is drawn
+      //once for every face whose frustum it touches rather than into all six
+      scratch.staticCasters.clear();
+      m_staticBounds.CullSphere(position, (float)farPlane, scratch.staticCasters);
+      scratch.animatedCasters.clear();
+      m_animatedBounds.CullSphere(position, (float)farPlane, scratch.animatedCasters);
+      SplitCubeFaces(commands.lightTransforms, m_staticBounds, scratch.staticCasters, scratch.staticFaces);
+      SplitCubeFaces(commands.lightTransforms, m_animatedBounds, scratch.animatedCasters, scratch.animatedFaces);
+
+      commands.size = GLsizei(block.shadowRect.z * SHADOW_LAYER_SIZE + 0.5f);
+      const float planes[2] = {(float)nearPlane, (float)farPlane};
+      commands.lightKey = ShadowCache::Hash(planes, sizeof(planes), ShadowCache::Hash(&position, sizeof(position)));
+    }
+    else
+    {
+      //Only meshes inside the light's frustum can cast into its shadow map
+      const Frustum frustum(block.matLight);
+      scratch.staticCasters.clear();
+      m_staticBounds.CullFrustum(frustum, scratch.staticCasters);
+      scratch.animatedCasters.clear();
+      m_animatedBounds.CullFrustum(frustum, scratch.animatedCasters);
+
+      commands.lightTransforms[0] = block.matLight;
+      commands.size = GLsizei(block.shadowRect.z * SHADOW_ATLAS_SIZE + 0.5f);
+      commands.lightKey = ShadowCache::Hash(&block.matLight, sizeof(block.matLight));
+    }
 
-      Texture *pNormal = model.mat ? model.mat->m_pNormal : nullptr;
-      if(!pNormal)
-        pNormal = m_pDefaultNormal;
+    //Any static mesh entering, leaving or moving within range changes the hash
+    commands.casterHash = ShadowCache::Hash(&commands.size, sizeof(commands.size));
+    for(uint32_t index : scratch.staticCasters)
+    {
+      const StaticMeshInstance& model = m_staticMeshes[index];
+      commands.casterHash = ShadowCache::Hash(&model.mesh, sizeof(model.mesh), commands.casterHash);
+      commands.casterHash = ShadowCache::Hash(&model.pos, sizeof(model.pos), commands.casterHash);
+    }
 
-      Texture *pMetallic = model.mat ? model.mat->m_pMetallic : nullptr;
-      if(!pMetallic)
-        pMetallic = m_pDefaultMetallic;
+    //Spot maps, and cubes whose faces the vertex shader can pick, take every caster in one pass.
+    //Otherwise each face is a pass of its own, through a framebuffer holding just that layer.
+    const bool bPerFace = commands.bCube && !m_bVertexLayer;
+    commands.passes.resize(bPerFace ? 6 : 1);
+    for(size_t i = 0; i < commands.passes.size(); ++i)
+      commands.passes[i].face = bPerFace ? (int)i : -1;
 
-      Texture *pRoughness = model.mat ? model.mat->m_pRoughness : nullptr;
-      if(!pRoughness)
-        pRoughness = m_pDefaultRoughness;
+    RecordShadowPasses(commands, false, scratch, commands.bCube ? sort_program_cube_shadows : sort_program_shadows);
+    RecordShadowPasses(commands, true, scratch, commands.bCube ? sort_program_anim_cube_shadows : sort_program_anim_shadows);
+  }
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, pLambert->m_glTexture);
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, pNormal->m_glTexture);
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, pMetallic->m_glTexture);
-      glActiveTexture(GL_TEXTURE3);
-      glBindTexture(GL_TEXTURE_2D, pRoughness->m_glTexture);
+  void Renderer::RecordShadowPasses(ShadowCommands& commands, bool bAnimated, RecordScratch& scratch, uint32_t program) const
+  {
+    const LightBlock& block = LightBlockAt(commands.block);
+    const std::vector<uint32_t>& casters = bAnimated ? scratch.animatedCasters : scratch.staticCasters;
+    const std::vector<uint32_t>& faces = bAnimated ? scratch.animatedFaces : scratch.staticFaces;
 
-      glBindVertexArray(model.mesh->m_vaoConfig);
+    for(ShadowPass& pass : commands.passes)
+    {
+      const std::vector<uint32_t>* pCasters = &casters;
+      const std::vector<uint32_t>* pLayers = commands.bCube ? &faces : nullptr;
+      if(pass.face >= 0)
+      {
+        scratch.faceCasters.clear();
+        for(size_t i = 0; i < casters.size(); ++i)
+        {
+          if(faces[i] == (uint32_t)pass.face)
+            scratch.faceCasters.push_back(casters[i]);
+        }
+        scratch.faceLayers.assign(scratch.faceCasters.size(), pass.face);
+        pCasters = &scratch.faceCasters;
+        pLayers = &scratch.faceLayers;
+      }
 
-      if(model.mesh->m_iNumIndices > 0)
+      if(bAnimated)
       {
-        glDrawElements(GL_TRIANGLES, model.mesh->m_iNumIndices, GL_UNSIGNED_INT, 0);
+        QueueDraws(scratch.queue, draw_pass_shadow, program, *pCasters, m_animatedMeshes, m_animatedBounds, block.pos, block.farPlane, pLayers);
+        pass.animatedDraws.assign(scratch.queue.begin(), scratch.queue.end());
       }
       else
       {
-        glDrawArrays(GL_TRIANGLES, 0, model.mesh->m_iNumTris*3);
+        QueueDraws(scratch.queue, draw_pass_shadow, program, *pCasters, m_staticMeshes, m_staticBounds, block.pos, block.farPlane, pLayers);
+        BuildStaticDraws(scratch.queue, false, pass.staticDraws);
       }
     }
-
-    glBindVertexArray(0);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
   }
 
-  void Renderer::DrawPointLights()
+  template<typename Instance>
+  void Renderer::QueueDraws(DrawQueue& queue, DrawPass pass, uint32_t program, const std::vector<uint32_t>& indices,
+      const std::vector<Instance>& instances, const CullingBatch& bounds, glm::vec3 eyePos, float farPlane,
+      const std::vector<uint32_t>* pLayers) const
   {
-    const GLint matViewLoc         = glGetUniformLocation(m_shdPointLight, "matView");
-    const GLint viewPosLoc         = glGetUniformLocation(m_shdPointLight, "viewPos");
-    const GLint screenSizeLoc      = glGetUniformLocation(m_shdPointLight, "screenSize");
-    const GLint sampLambertLoc     = glGetUniformLocation(m_shdPointLight, "sampLambert");
-    const GLint sampNormalLoc      = glGetUniformLocation(m_shdPointLight, "sampNormal");
-    const GLint sampPBRMapsLoc     = glGetUniformLocation(m_shdPointLight, "sampPBRMaps");
-    const GLint sampDepthLoc       = glGetUniformLocation(m_shdPointLight, "sampDepth");
-    const GLint sampShadowLoc      = glGetUniformLocation(m_shdPointLight, "sampShadow");
-    const GLint lightPosLoc        = glGetUniformLocation(m_shdPointLight, "lightPos");
-    const GLint lightColorLoc      = glGetUniformLocation(m_shdPointLight, "lightColor");
-    const GLint lightBrightnessLoc = glGetUniformLocation(m_shdPointLight, "lightBrightness");
-    const GLint farPlaneLoc        = glGetUniformLocation(m_shdPointLight, "farPlane");
-
-
-    for(size_t i = 0; i < m_pointLights.size(); ++i)
+    //Group draws by the texture arrays their materials sample then mesh, nearest the eye first so early-z rejects more
+    queue.Clear();
+    for(size_t i = 0; i < indices.size(); ++i)
     {
-      const PointLight& light = m_pointLights[i];
-
-      // First render shadow map
-      const double nearPlane = 0.1, farPlane = 30.0;
-
-      if(i > 0)
-      {
-        //We've waited until the last possible moment now - retrieve the shadow query
-        GLuint64 shadow_start, shadow_end;
-        glGetQueryObjectui64v(m_qryShadows[0], GL_QUERY_RESULT, &shadow_start);
-        glGetQueryObjectui64v(m_qryShadows[1], GL_QUERY_RESULT, &shadow_end);
-        m_shadowTime += double(shadow_end - shadow_start) / 1e6;
-      }
+      const uint32_t index = indices[i];
+      const Instance& model = instances[index];
+      //Shadows ignore materials
+      const uint32_t material = pass == draw_pass_geometry ? m_materialTextureSets[model.materialId] : 0;
+      const float depth = glm::distance(bounds.Center(index), eyePos) / farPlane;
+      queue.Add(DrawQueue::MakeKey(pass, program, material, model.meshId, depth), index, pLayers ? (*pLayers)[i] : 0);
+    }
+    queue.Sort();
+  }
 
-      glQueryCounter(m_qryShadows[0], GL_TIMESTAMP);
-      DrawPointShadowMap(light.pos, nearPlane, farPlane);
-      glQueryCounter(m_qryShadows[1], GL_TIMESTAMP);
-      glBindFramebuffer(GL_FRAMEBUFFER, m_compositeFBO);
+  uint32_t Renderer::MeshId(const void* pMesh)
+  {
+    auto it = m_meshIds.find(pMesh);
+    if(it != m_meshIds.end())
+      return it->second;
 
-      // Now render lighting shader
-      glUseProgram(m_shdPointLight);
+    const uint32_t id = m_meshIds.size();
+    m_meshIds[pMesh] = id;
+    return id;
+  }
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, m_texLambert);
+  uint32_t Renderer::MaterialId(const Material* pMat)
+  {
+    auto it = m_materialIds.find(pMat);
+    if(it != m_materialIds.end())
+      return it->second;
 
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, m_texNormal);
+    //Past the size of the table draw with the default material
+    if(m_materialLayers.size() >= MAX_MATERIALS)
+    {
+      std::cerr << "Material table is full, drawing with the default material" << std::endl;
+      m_materialIds[pMat] = 0;
+      return 0;
+    }
 
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, m_texPBRMaps);
+    Texture *pLambert = pMat ? pMat->m_pLambert : nullptr;
+    if(!pLambert)
+      pLambert = m_pDefaultLambert;
 
-      glActiveTexture(GL_TEXTURE3);
-      glBindTexture(GL_TEXTURE_2D, m_texDepth);
+    Texture *pNormal = pMat ? pMat->m_pNormal : nullptr;
+    if(!pNormal)
+      pNormal = m_pDefaultNormal;
 
-      glActiveTexture(GL_TEXTURE4);
-      glBindTexture(GL_TEXTURE_CUBE_MAP, m_texShadowCube);
+    Texture *pMetallic = pMat ? pMat->m_pMetallic : nullptr;
+    if(!pMetallic)
+      pMetallic = m_pDefaultMetallic;
 
-      glUniformMatrix4fv(matViewLoc, 1, GL_FALSE, &m_matProjection[0][0]);
-      glUniform3f(viewPosLoc, m_viewPos.x, m_viewPos.y, m_viewPos.z);
-      glUniform2f(screenSizeLoc, (float)m_width, (float)m_height);
-      glUniform1i(sampLambertLoc, 0);
-      glUniform1i(sampNormalLoc,  1);
-      glUniform1i(sampPBRMapsLoc, 2);
-      glUniform1i(sampDepthLoc,   3);
-      glUniform1i(sampShadowLoc,  4);
-      glUniform3f(lightPosLoc, light.pos.x, light.pos.y, light.pos.z);
-      glUniform3f(lightColorLoc, light.color.x, light.color.y, light.color.z);
-      glUniform1f(lightBrightnessLoc, light.brightness);
-      glUniform1f(farPlaneLoc, (float)farPlane);
+    Texture *pRoughness = pMat ? pMat->m_pRoughness : nullptr;
+    if(!pRoughness)
+      pRoughness = m_pDefaultRoughness;
 
-      glDepthFunc(GL_ALWAYS);
-      glBindVertexArray(m_pPlane->m_vaoConfig);
-      glDrawArrays(GL_TRIANGLES, 0, m_pPlane->m_iNumTris*3);
-      glBindVertexArray(0);
+    const TextureSet set = {{pLambert->m_glTexture, pNormal->m_glTexture, pMetallic->m_glTexture, pRoughness->m_glTexture}};
 
-    }
+    //Few distinct sets exist when textures share sizes and formats, so a linear search is fine
+    uint32_t textureSet = 0;
+    while(textureSet < m_textureSets.size() && memcmp(&m_textureSets[textureSet], &set, sizeof(TextureSet)) != 0)
+      ++textureSet;
+    if(textureSet == m_textureSets.size())
+      m_textureSets.push_back(set);
 
-    if(!m_pointLights.empty())
-    {
-      //We've waited until the last possible moment now - retrieve the shadow query
-      GLuint64 shadow_start, shadow_end;
-      glGetQueryObjectui64v(m_qryShadows[0], GL_QUERY_RESULT, &shadow_start);
-      glGetQueryObjectui64v(m_qryShadows[1], GL_QUERY_RESULT, &shadow_end);
-      m_shadowTime += double(shadow_end - shadow_start) / 1e6;
-    }
+    const uint32_t id = m_materialLayers.size();
+    m_materialLayers.push_back(glm::ivec4(pLambert->m_layer, pNormal->m_layer, pMetallic->m_layer, pRoughness->m_layer));
+    m_materialTextureSets.push_back(textureSet);
+    m_materialIds[pMat] = id;
+    return id;
   }
 
-  void Renderer::DrawDirectionalLights()
+  void Renderer::UploadFrameConstants()
   {
-    glUseProgram(m_shdDirectionalLight);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_texLambert);
+    FrameBlock frame;
+    frame.matView = m_matProjection;
+    //Inverted once here rather than per pixel, which also keeps the reconstructed positions precise
+    frame.matInvView = glm::inverse(m_matProjection);
+    frame.viewPos = m_viewPos;
+    frame.time = (float)m_curTime;
+    frame.screenSize = glm::vec2(m_width, m_height);
+    frame.viewNear = VIEW_NEAR_PLANE;
+    frame.viewFar = VIEW_FAR_PLANE;
+    frame.compactGBuffer = m_bCompactGBuffer;
+
+    const GLintptr offset = m_stream.Push(&frame, sizeof(FrameBlock), m_uniformAlignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, m_stream.Buffer(), offset, sizeof(FrameBlock));
+  }
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_texNormal);
+  void Renderer::BuildLightBlocks()
+  {
+    //Point lights first, then spot lights, then directional lights
+    const size_t numLights = m_pointLights.size() + m_spotLights.size() + m_directionalLights.size();
+    m_lightBlocks.assign(std::max<size_t>(numLights, 1) * m_lightBlockStride, 0);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, m_texPBRMaps);
+    //Shadowed lights are handed slots in the atlas and array in order until they run out
+    m_numSpotShadows = 0;
+    m_numPointShadows = 0;
+    m_atlasRequests.clear();
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, m_texDepth);
+    size_t index = 0;
+    for(const PointLight& light : m_pointLights)
+    {
+      LightBlock& block = LightBlockAt(index++);
+      block.radius = CalcLightRadius(light.radius, light.color, light.brightness);
+      //The sphere is unit diameter
+      block.matPos = glm::scale(glm::translate(glm::mat4(1.0), light.pos), glm::vec3(2.0f * block.radius * LIGHT_VOLUME_PADDING));
+      block.matLight = glm::mat4(1.0);
+      block.pos = light.pos;
+      block.dir = glm::vec3(0.0f);
+      block.brightness = light.brightness;
+      block.color = light.color;
+      block.innerAngle = 0.0f;
+      block.outerAngle = 0.0f;
+      block.nearPlane = SHADOW_NEAR_PLANE;
+      block.farPlane = block.radius;
+      block.useShadows = light.castShadows && m_numPointShadows < MAX_POINT_SHADOWS;
+      //Faces smaller than the array's layers take their bottom left corner
+      const GLsizei size = std::min(ShadowResolution(light.pos, block.radius), SHADOW_LAYER_SIZE);
+      block.shadowRect = glm::vec4(0.0f, 0.0f, size, size) / float(SHADOW_LAYER_SIZE);
+      block.shadowLayer = block.useShadows ? 6 * m_numPointShadows++ : 0;
+    }
 
-    glUniform2f(glGetUniformLocation(m_shdDirectionalLight, "screenSize"), (float)m_width, (float)m_height);
-    glUniform1i(glGetUniformLocation(m_shdDirectionalLight, "sampLambert"), 0);
-    glUniform1i(glGetUniformLocation(m_shdDirectionalLight, "sampNormal"), 1);
-    glUniform1i(glGetUniformLocation(m_shdDirectionalLight, "sampPBRMaps"), 2);
-    glUniform1i(glGetUniformLocation(m_shdDirectionalLight, "sampDepth"), 3);
+    for(const SpotLight& light : m_spotLights)
+    {
+      LightBlock& block = LightBlockAt(index++);
+      block.radius = CalcLightRadius(light.radius, light.color, light.brightness);
+      block.nearPlane = SHADOW_NEAR_PLANE;
+      block.farPlane = block.radius;
 
-    const GLint lightDirLoc = glGetUniformLocation(m_shdDirectionalLight, "lightDir");
-    const GLint lightColorLoc = glGetUniformLocation(m_shdDirectionalLight, "lightColor");
-    const GLint lightBrightnessLoc = glGetUniformLocation(m_shdDirectionalLight, "lightBrightness");
+      const glm::mat4 lightProj = glm::perspective(light.outerAngle * 2.0, 1.0, (double)block.nearPlane, (double)block.farPlane);
+      const glm::mat4 lightView = glm::lookAt(light.pos, light.pos + light.dir, glm::vec3(0,1,0));
+      block.matLight = lightProj * lightView;
+
+      //The cone's apex sits at the light and its unit base lies one unit down -z
+      const float baseRadius = block.radius * glm::tan(light.outerAngle);
+      block.matPos = glm::inverse(lightView) * glm::scale(glm::mat4(1.0), glm::vec3(baseRadius, baseRadius, block.radius) * LIGHT_VOLUME_PADDING);
+      block.pos = light.pos;
+      block.dir = light.dir;
+      block.brightness = light.brightness;
+      block.color = light.color;
+      block.innerAngle = glm::cos(light.innerAngle);
+      block.outerAngle = glm::cos(light.outerAngle);
+      //Given a tile by PackShadowAtlas once every spot light has asked for one
+      block.useShadows = true;
+      block.shadowRect = glm::vec4(0.0f);
+      block.shadowLayer = 0;
+      m_atlasRequests.push_back(AtlasRequest{ShadowResolution(light.pos, block.radius), index - 1});
+    }
+    PackShadowAtlas();
 
-    glBindVertexArray(m_pPlane->m_vaoConfig);
-    for(auto& light : m_directionalLights)
+    for(const DirectionalLight& light : m_directionalLights)
     {
-      glUniform3f(lightDirLoc, light.dir.x, light.dir.y, light.dir.z);
-      glUniform3f(lightColorLoc, light.color.x, light.color.y, light.color.z);
-      glUniform1f(lightBrightnessLoc, light.brightness);
-      glDrawArrays(GL_TRIANGLES, 0, m_pPlane->m_iNumTris*3);
+      LightBlock& block = LightBlockAt(index++);
+      block.matPos = glm::mat4(1.0);
+      block.matLight = glm::mat4(1.0);
+      block.pos = glm::vec3(0.0f);
+      block.radius = 0.0f;
+      block.dir = light.dir;
+      block.brightness = light.brightness;
+      block.color = light.color;
+      block.innerAngle = 0.0f;
+      block.outerAngle = 0.0f;
+      block.nearPlane = 0.0f;
+      block.farPlane = 0.0f;
+      block.useShadows = false;
+      block.shadowRect = glm::vec4(0.0f);
+      block.shadowLayer = 0;
     }
-    glBindVertexArray(0);
   }
 
-  void Renderer::DrawSpotLights()
+  void Renderer::UploadLights()
   {
-    const GLint matViewLoc         = glGetUniformLocation(m_shdSpotLight, "matView");
-    const GLint matLightProjLoc    = glGetUniformLocation(m_shdSpotLight, "matLightProj");
-    const GLint screenSizeLoc      = glGetUniformLocation(m_shdSpotLight, "screenSize");
-    const GLint sampLambertLoc     = glGetUniformLocation(m_shdSpotLight, "sampLambert");
-    const GLint sampNormalLoc      = glGetUniformLocation(m_shdSpotLight, "sampNormal");
-    const GLint sampPBRMapsLoc     = glGetUniformLocation(m_shdSpotLight, "sampPBRMaps");
-    const GLint sampDepthLoc       = glGetUniformLocation(m_shdSpotLight, "sampDepth");
-    const GLint sampShadowLoc      = glGetUniformLocation(m_shdSpotLight, "sampShadow");
-    const GLint lightPosLoc        = glGetUniformLocation(m_shdSpotLight, "lightPos");
-    const GLint lightDirLoc        = glGetUniformLocation(m_shdSpotLight, "lightDir");
-    const GLint innerAngleLoc      = glGetUniformLocation(m_shdSpotLight, "innerAngle");
-    const GLint outerAngleLoc      = glGetUniformLocation(m_shdSpotLight, "outerAngle");
-    const GLint lightColorLoc      = glGetUniformLocation(m_shdSpotLight, "lightColor");
-    const GLint lightBrightnessLoc = glGetUniformLocation(m_shdSpotLight, "lightBrightness");
-    const GLint nearPlaneLoc       = glGetUniformLocation(m_shdSpotLight, "nearPlane");
-    const GLint farPlaneLoc        = glGetUniformLocation(m_shdSpotLight, "farPlane");
+    m_lightBlocksOffset = m_stream.Push(m_lightBlocks.data(), m_lightBlocks.size(), m_uniformAlignment);
+    m_lightBlocksBuffer = m_stream.Buffer();
+  }
 
-    for(size_t i = 0; i < m_spotLights.size(); ++i)
-    {
-      const SpotLight& light = m_spotLights[i];
+  GLsizei Renderer::ShadowResolution(glm::vec3 pos, float radius) const
+  {
+    //Pixels across the light's sphere of influence, the whole screen once the camera is inside it
+    const float dist = glm::distance(pos, m_viewPos);
+    const float focalLength = 1.0f / glm::tan(glm::radians(VIEW_FIELD_OF_VIEW) * 0.5f);
+    const float screenSize = dist > radius ? radius / dist * focalLength * m_height : float(MAX_SHADOW_SIZE);
+
+    //Powers of two so tiles pack into the atlas without gaps
+    GLsizei size = MIN_SHADOW_SIZE;
+    while(size < screenSize && size < MAX_SHADOW_SIZE)
+      size *= 2;
+    return size;
+  }
 
-      //First render shadow map
-      const double nearPlane = 0.1, farPlane = 30.0;
-      const glm::mat4 lightProj = glm::perspective(light.outerAngle * 2.0, 1.0, nearPlane, farPlane);
-      const glm::mat4 lightView = glm::lookAt(light.pos, light.pos + light.dir, glm::vec3(0,1,0));
-      const glm::mat4 lightSpace = lightProj * lightView;
+  void Renderer::PackShadowAtlas()
+  {
+    //Largest first, so each tile starts a multiple of its own area along the Z order curve.
+    //That puts it on the grid of tiles its size, and tiles never overlap.
+    std::stable_sort(m_atlasRequests.begin(), m_atlasRequests.end(),
+        [](const AtlasRequest& a, const AtlasRequest& b) { return a.size > b.size; });
+
+    const uint32_t cellsPerSide = SHADOW_ATLAS_SIZE / MIN_SHADOW_SIZE;
+    const uint32_t numCells = cellsPerSide * cellsPerSide;
+    uint32_t nextCell = 0;
+    GLsizei maxSize = MAX_SHADOW_SIZE;
+    for(const AtlasRequest& request : m_atlasRequests)
+    {
+      LightBlock& block = LightBlockAt(request.blockIndex);
 
-      if(i > 0)
+      //Once the atlas fills up lights get smaller tiles, and so does every light after them to keep the order
+      GLsizei size = std::min(request.size, maxSize);
+      uint32_t cells = (size / MIN_SHADOW_SIZE) * (size / MIN_SHADOW_SIZE);
+      while(cells > numCells - nextCell && size > MIN_SHADOW_SIZE)
       {
-        //We've waited until the last possible moment now - retrieve the shadow query
-        GLuint64 shadow_start, shadow_end;
-        glGetQueryObjectui64v(m_qryShadows[0], GL_QUERY_RESULT, &shadow_start);
-        glGetQueryObjectui64v(m_qryShadows[1], GL_QUERY_RESULT, &shadow_end);
-        m_shadowTime += double(shadow_end - shadow_start) / 1e6;
+        size /= 2;
+        cells /= 4;
       }
+      maxSize = size;
 
-      glQueryCounter(m_qryShadows[0], GL_TIMESTAMP);
-      DrawSpotShadowMap(lightSpace);
-      glQueryCounter(m_qryShadows[1], GL_TIMESTAMP);
+      if(cells > numCells - nextCell)
+      {
+        block.useShadows = false;
+        continue;
+      }
 
-      glBindFramebuffer(GL_FRAMEBUFFER, m_compositeFBO);
-      glBindFramebuffer(GL_FRAMEBUFFER, m_compositeFBO);
+      const glm::ivec2 cell = MortonDecode(nextCell) * MIN_SHADOW_SIZE;
+      block.shadowRect = glm::vec4(cell.x, cell.y, size, size) / float(SHADOW_ATLAS_SIZE);
+      nextCell += cells;
+      ++m_numSpotShadows;
+    }
+  }
 
-      // Now render lighting shader
-      glUseProgram(m_shdSpotLight);
+  void Renderer::UploadBonePalette()
+  {
+    if(m_bonePalette.empty())
+      return;
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, m_texLambert);
+    const size_t numBones = m_bonePalette.size() / 3;
+    const GLsizei rows = (numBones + BONES_PER_ROW - 1) / BONES_PER_ROW;
 
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, m_texNormal);
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texBonePalette);
+    if(rows > m_bonePaletteRows)
+    {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, BONES_PER_ROW * 3, rows, 0, GL_RGBA, GL_FLOAT, NULL);
+      m_bonePaletteRows = rows;
+    }
 
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, m_texPBRMaps);
+    //Copied into the texture by the GPU from the stream buffer, whole rows at a time
+    const size_t size = rows * BONES_PER_ROW * 3 * sizeof(glm::vec4);
+    const GLintptr offset = m_stream.Allocate(size, sizeof(glm::vec4));
+    m_stream.Write(offset, m_bonePalette.data(), m_bonePalette.size() * sizeof(glm::vec4));
 
-      glActiveTexture(GL_TEXTURE3);
-      glBindTexture(GL_TEXTURE_2D, m_texDepth);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stream.Buffer());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BONES_PER_ROW * 3, rows, GL_RGBA, GL_FLOAT, (void*)offset);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
 
-      glActiveTexture(GL_TEXTURE4);
-      glBindTexture(GL_TEXTURE_2D, m_texShadow);
+  Renderer::LightBlock& Renderer::LightBlockAt(size_t index)
+  {
+    return *reinterpret_cast<LightBlock*>(&m_lightBlocks[index * m_lightBlockStride]);
+  }
 
-      glUniformMatrix4fv(matViewLoc, 1, GL_FALSE, &m_matProjection[0][0]);
-      glUniformMatrix4fv(matLightProjLoc, 1, GL_FALSE, &lightSpace[0][0]);
-      glUniform2f(screenSizeLoc, (float)m_width, (float)m_height);
-      glUniform1i(sampLambertLoc, 0);
-      glUniform1i(sampNormalLoc,  1);
-      glUniform1i(sampPBRMapsLoc, 2);
-      glUniform1i(sampDepthLoc,   3);
-      glUniform1i(sampShadowLoc,  4);
-      glUniform3f(lightPosLoc, light.pos.x, light.pos.y, light.pos.z);
-      glUniform3f(lightDirLoc, light.dir.x, light.dir.y, light.dir.z);
-      glUniform1f(innerAngleLoc, glm::cos(light.innerAngle));
-      glUniform1f(outerAngleLoc, glm::cos(light.outerAngle));
-      glUniform3f(lightColorLoc, light.color.x, light.color.y, light.color.z);
-      glUniform1f(lightBrightnessLoc, light.brightness);
-      glUniform1f(nearPlaneLoc, nearPlane);
-      glUniform1f(farPlaneLoc, farPlane);
+  const Renderer::LightBlock& Renderer::LightBlockAt(size_t index) const
+  {
+    return *reinterpret_cast<const LightBlock*>(&m_lightBlocks[index * m_lightBlockStride]);
+  }
 
-      glDepthFunc(GL_ALWAYS);
-      glBindVertexArray(m_pPlane->m_vaoConfig);
-      glDrawArrays(GL_TRIANGLES, 0, m_pPlane->m_iNumTris*3);
-      glBindVertexArray(0);
+  void Renderer::BindLightBlock(size_t index)
+  {
+    glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, m_lightBlocksBuffer, m_lightBlocksOffset + index * m_lightBlockStride, sizeof(LightBlock));
+  }
 
-    }
+  void Renderer::UploadMaterials()
+  {
+    //The bound range has to cover the whole block even though only the used entries are written
+    const size_t size = MAX_MATERIALS * sizeof(glm::ivec4);
+    const GLintptr offset = m_stream.Allocate(size, m_uniformAlignment);
+    m_stream.Write(offset, m_materialLayers.data(), m_materialLayers.size() * sizeof(glm::ivec4));
+    glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, m_stream.Buffer(), offset, size);
+  }
 
-    if(!m_spotLights.empty())
+  void Renderer::BindTextureSet(uint32_t textureSet)
+  {
+    const TextureSet& set = m_textureSets[textureSet];
+    for(int i = 0; i < 4; ++i)
     {
-      //We've waited until the last possible moment now - retrieve the shadow query
-      GLuint64 shadow_start, shadow_end;
-      glGetQueryObjectui64v(m_qryShadows[0], GL_QUERY_RESULT, &shadow_start);
-      glGetQueryObjectui64v(m_qryShadows[1], GL_QUERY_RESULT, &shadow_end);
-      m_shadowTime += double(shadow_end - shadow_start) / 1e6;
+      m_state.BindTexture(i, GL_TEXTURE_2D_ARRAY, set.arrays[i]);
     }
   }
 
-  void Renderer::DrawSpotShadowMap(glm::mat4 lightProj)
+  void Renderer::DrawStaticMeshes(bool bDepthOnly)
   {
-    glViewport(0, 0, m_shadowMapSize, m_shadowMapSize);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_shadowFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    glDepthFunc(GL_LESS);
-    glUseProgram(m_shdShadows);
-    glUniformMatrix4fv(glGetUniformLocation(m_shdShadows, "matLightProj"), 1, GL_FALSE, &lightProj[0][0]);
-    const GLint matPosLoc = glGetUniformLocation(m_shdShadows, "matPos");
-
-    for(auto& model : m_staticMeshes)
+    //Recorded with texture set batches either way, so the g buffer pass can repeat a pre-pass's draws
+    if(!m_bOcclusionCulling)
     {
-      glUniformMatrix4fv(matPosLoc, 1, GL_FALSE, &model.pos[0][0]);
+      if(m_viewDraws.commands.empty())
+        return;
 
-      glBindVertexArray(model.mesh->m_vaoConfig);
+      m_staticDrawsBuffer = PushStaticDraws(m_viewDraws, m_staticCommandsOffset);
 
-      if(model.mesh->m_iNumIndices > 0)
-      {
-        glDrawElements(GL_TRIANGLES, model.mesh->m_iNumIndices, GL_UNSIGNED_INT, 0);
-      }
-      else
-      {
-        glDrawArrays(GL_TRIANGLES, 0, model.mesh->m_iNumTris*3);
-      }
+      (bDepthOnly ? m_shdDepth : m_shdStaticMesh).Use();
+      IssueStaticDraws(m_viewDraws, m_staticDrawsBuffer, m_staticCommandsOffset, !bDepthOnly);
+      return;
+    }
 
-      glBindVertexArray(0);
+    //Draw what was in view last frame, build this frame's pyramid from it, then give whatever
+    //the first pass hid a second test against the new depth so nothing revealed pops in late
+    if(!m_viewDraws.commands.empty())
+    {
+      UploadOcclusionData();
+      CullOccludedMeshes(0, m_matHiZ);
+      DrawCulledStaticMeshes(0, bDepthOnly);
     }
 
-    glViewport(0, 0, m_width, m_height);
+    BuildHiZ();
+
+    if(!m_viewDraws.commands.empty())
+    {
+      CullOccludedMeshes(1, m_matProjection);
+      DrawCulledStaticMeshes(1, bDepthOnly);
+    }
   }
 
-  void Renderer::DrawPointShadowMap(glm::vec3 position, double nearPlane, double farPlane)
+  void Renderer::RedrawStaticMeshes()
   {
-    glViewport(0, 0, m_shadowMapSize, m_shadowMapSize);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_shadowCubeFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
+    if(m_viewDraws.commands.empty())
+      return;
 
-    glDepthFunc(GL_LESS);
-    glUseProgram(m_shdCubeShadows);
+    if(!m_bOcclusionCulling)
+    {
+      //The instances and commands are still where the pre-pass put them
+      m_shdStaticMesh.Use();
+      IssueStaticDraws(m_viewDraws, m_staticDrawsBuffer, m_staticCommandsOffset, true);
+      return;
+    }
 
-    glm::mat4 lightProj = glm::perspective(glm::radians(90.0), 1.0, nearPlane, farPlane);
-    glm::mat4 lightTransforms[6] = {
-      lightProj * glm::lookAt(position, position + glm::vec3( 1,0,0), glm::vec3(0,-1,0)),
-      lightProj * glm::lookAt(position, position + glm::vec3(-1,0,0), glm::vec3(0,-1,0)),
-      lightProj * glm::lookAt(position, position + glm::vec3(0, 1,0), glm::vec3(0,0, 1)),
-      lightProj * glm::lookAt(position, position + glm::vec3(0,-1,0), glm::vec3(0,0,-1)),
-      lightProj * glm::lookAt(position, position + glm::vec3(0,0, 1), glm::vec3(0,-1,0)),
-      lightProj * glm::lookAt(position, position + glm::vec3(0,0,-1), glm::vec3(0,-1,0))
-    };
+    //Both phases' survivors are already known, their commands are reused as they are
+    DrawCulledStaticMeshes(0, false);
+    DrawCulledStaticMeshes(1, false);
+  }
 
-    glUniformMatrix4fv(glGetUniformLocation(m_shdCubeShadows, "matLightPos"), 6, GL_FALSE, &lightTransforms[0][0][0]);
+  void Renderer::DrawStaticList(const StaticDrawList& list, bool bBindMaterials)
+  {
+    if(list.commands.empty())
+      return;
 
-    glm::mat4 identity(1.0);
-    glUniformMatrix4fv(glGetUniformLocation(m_shdCubeShadows, "matLightProj"), 1, GL_FALSE, &identity[0][0]);
+    GLintptr commandsOffset = 0;
+    const GLuint buffer = PushStaticDraws(list, commandsOffset);
 
-    glUniform3f(glGetUniformLocation(m_shdCubeShadows, "lightPos"), position.x, position.y, position.z);
-    glUniform1f(glGetUniformLocation(m_shdCubeShadows, "farPlane"), (float)farPlane);
-    const GLint staticMatPosLoc = glGetUniformLocation(m_shdCubeShadows, "matPos");
+    m_stateChangesSaved += list.stateChangesSaved;
+    IssueStaticDraws(list, buffer, commandsOffset, bBindMaterials);
+  }
 
-    for(auto& model : m_staticMeshes)
-    {
-      glUniformMatrix4fv(staticMatPosLoc, 1, GL_FALSE, &model.pos[0][0]);
+  GLuint Renderer::PushStaticDraws(const StaticDrawList& list, GLintptr& commandsOffset)
+  {
+    //One allocation for both, two pushes could land in different buffers if the second outgrew the ring
+    const size_t instancesSize = list.instances.size() * sizeof(InstanceData);
+    const size_t commandsSize = m_bMultiDraw ? list.commands.size() * sizeof(DrawElementsIndirectCommand) : 0;
+    m_instanceOffset = m_stream.Allocate(instancesSize + commandsSize, sizeof(InstanceData));
+    m_stream.Write(m_instanceOffset, list.instances.data(), instancesSize);
+
+    //InstanceData is a whole number of words, so the commands stay aligned
+    commandsOffset = m_instanceOffset + instancesSize;
+    if(commandsSize)
+      m_stream.Write(commandsOffset, list.commands.data(), commandsSize);
+
+    return m_stream.Buffer();
+  }
+
+  void Renderer::BuildStaticDraws(const DrawQueue& queue, bool bBindMaterials, StaticDrawList& list) const
+  {
+    //Copy the transforms out in draw order so each run of matching draws reads a contiguous range.
+    //Materials travel with the instance, so only the texture arrays they sample from split runs.
+    list.instances.clear();
+    for(const DrawQueue::Entry& entry : queue)
+    {
+      const StaticMeshInstance& model = m_staticMeshes[entry.index];
+      //Shadow draws have no material, the slot carries their cube face instead
+      const uint32_t material = bBindMaterials ? model.materialId : entry.layer;
+      list.instances.push_back(InstanceData{model.pos, material, 0, {0, 0}});
+    }
+
+    //The queue is sorted, so instances sharing a mesh (and texture set, when it is bound) are adjacent.
+    //Each run becomes one command and commands are batched until the texture set changes.
+    list.commands.clear();
+    list.batches.clear();
+    list.stateChangesSaved = 0;
+    size_t first = 0;
+    while(first < queue.Size())
+    {
+      const StaticMeshInstance& model = m_staticMeshes[queue[first].index];
+      const uint32_t textureSet = bBindMaterials ? m_materialTextureSets[list.instances[first].material] : 0;
+      size_t count = 1;
+      while(first + count < queue.Size())
+      {
+        const StaticMeshInstance& next = m_staticMeshes[queue[first + count].index];
+        const uint32_t nextTextureSet = bBindMaterials ? m_materialTextureSets[list.instances[first + count].material] : 0;
+        if(next.mesh != model.mesh || nextTextureSet != textureSet)
+          break;
+        ++count;
+      }
+
+      if(list.batches.empty() || textureSet != list.batches.back().textureSet)
+        list.batches.push_back(DrawBatch{textureSet, list.commands.size(), 0});
+      else
+        ++list.stateChangesSaved;
+      ++list.batches.back().numCommands;
+
+      for(size_t i = first; i < first + count; ++i)
+        list.instances[i].command = list.commands.size();
+
+      DrawElementsIndirectCommand cmd;
+      cmd.count = model.mesh->m_iNumIndices;
+      cmd.instanceCount = count;
+      cmd.firstIndex = model.mesh->m_iFirstIndex;
+      cmd.baseVertex = model.mesh->m_iBaseVertex;
+      cmd.baseInstance = first;
+      list.commands.push_back(cmd);
+
+      first += count;
+    }
+  }
+
+  void Renderer::IssueStaticDraws(const StaticDrawList& list, GLuint buffer, GLintptr commandsOffset, bool bBindMaterials)
+  {
+    //Every static mesh lives in the arena, so one vertex array serves the whole queue
+    m_state.BindVertexArray(GeometryArena::Static().VertexArray());
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    BindInstanceData(0);
+
+    if(m_bMultiDraw)
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+
+    for(const DrawBatch& batch : list.batches)
+    {
+      if(bBindMaterials)
+        BindTextureSet(batch.textureSet);
+
+      if(m_bMultiDraw)
+      {
+        //Base instance offsets the per instance matrices, so one call covers the batch
+        const uintptr_t offset = commandsOffset + batch.firstCommand * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, batch.numCommands, 0);
+        ++m_drawCalls;
+        continue;
+      }
+
+      for(size_t i = batch.firstCommand; i < batch.firstCommand + batch.numCommands; ++i)
+      {
+        const DrawElementsIndirectCommand& cmd = list.commands[i];
+        BindInstanceData(cmd.baseInstance);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+            (void*)(uintptr_t(cmd.firstIndex) * sizeof(GLuint)), cmd.instanceCount, cmd.baseVertex);
+        ++m_drawCalls;
+      }
+    }
+
+    //Other draws from the arena are single meshes without instance data
+    for(int col = 0; col < 4; ++col)
+      glDisableVertexAttribArray(INSTANCE_MATRIX_LOCATION + col);
+    glDisableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+
+    m_state.BindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+
+  void Renderer::UploadOcclusionData()
+  {
+    //Bounding spheres of the boxes, in the same order as the instances
+    m_instanceSpheres.clear();
+    for(const DrawQueue::Entry& entry : m_staticQueue)
+      m_instanceSpheres.push_back(glm::vec4(m_staticBounds.Center(entry.index), glm::length(m_staticBounds.Extent(entry.index))));
+
+    //The culling pass counts instances back up from zero
+    for(DrawElementsIndirectCommand& cmd : m_viewDraws.commands)
+      cmd.instanceCount = 0;
+
+    const size_t numInstances = m_viewDraws.instances.size();
+    const size_t instancesSize = AlignUp(numInstances * sizeof(InstanceData), m_storageAlignment);
+    const size_t spheresSize = AlignUp(numInstances * sizeof(glm::vec4), m_storageAlignment);
+    const size_t commandsSize = AlignUp(m_viewDraws.commands.size() * sizeof(DrawElementsIndirectCommand), m_storageAlignment);
+
+    //One allocation so the three ranges can't be split across buffers if the stream grows
+    const GLintptr base = m_stream.Allocate(instancesSize + spheresSize + commandsSize, m_storageAlignment);
+    m_occlusionRanges.sourceInstances = base;
+    m_occlusionRanges.spheres = base + instancesSize;
+    const GLintptr commandsOffset = m_occlusionRanges.spheres + spheresSize;
+    m_stream.Write(m_occlusionRanges.sourceInstances, m_viewDraws.instances.data(), numInstances * sizeof(InstanceData));
+    m_stream.Write(m_occlusionRanges.spheres, m_instanceSpheres.data(), numInstances * sizeof(glm::vec4));
+    m_stream.Write(commandsOffset, m_viewDraws.commands.data(), m_viewDraws.commands.size() * sizeof(DrawElementsIndirectCommand));
+
+    //Each phase writes its own commands and visible instances, then the first phase's rejections
+    m_occlusionRanges.commands[0] = 0;
+    m_occlusionRanges.commands[1] = commandsSize;
+    m_occlusionRanges.instances[0] = commandsSize * 2;
+    m_occlusionRanges.instances[1] = commandsSize * 2 + instancesSize;
+    m_occlusionRanges.rejected = commandsSize * 2 + instancesSize * 2;
+    const size_t size = m_occlusionRanges.rejected + numInstances * sizeof(GLuint);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_occlusionBuffer);
+    if(size > m_occlusionBufferSize)
+    {
+      //Left a little room so a growing scene doesn't reallocate every frame
+      m_occlusionBufferSize = size + size / 2;
+      glBufferData(GL_COPY_WRITE_BUFFER, m_occlusionBufferSize, NULL, GL_DYNAMIC_COPY);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, m_stream.Buffer());
+    for(int phase = 0; phase < 2; ++phase)
+    {
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, commandsOffset, m_occlusionRanges.commands[phase],
+          m_viewDraws.commands.size() * sizeof(DrawElementsIndirectCommand));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  void Renderer::CullOccludedMeshes(int phase, const glm::mat4& matViewProj)
+  {
+    const size_t numInstances = m_viewDraws.instances.size();
+    const size_t commandsSize = m_viewDraws.commands.size() * sizeof(DrawElementsIndirectCommand);
+
+    m_shdOcclusion.Use();
+
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texHiZ);
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, m_stream.Buffer(), m_occlusionRanges.sourceInstances, numInstances * sizeof(InstanceData));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, m_stream.Buffer(), m_occlusionRanges.spheres, numInstances * sizeof(glm::vec4));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, m_occlusionBuffer, m_occlusionRanges.commands[phase], commandsSize);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, m_occlusionBuffer, m_occlusionRanges.instances[phase], numInstances * sizeof(InstanceData));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, m_occlusionBuffer, m_occlusionRanges.rejected, numInstances * sizeof(GLuint));
+
+    //Without an earlier frame's pyramid the first phase lets everything through
+    m_uniOcclusion.matViewProj.Set(matViewProj);
+    m_uniOcclusion.numInstances.Set(numInstances);
+    m_uniOcclusion.phase.Set(phase);
+    m_uniOcclusion.hiZLevels.Set(m_bHiZDrawn ? m_hiZMips : 0);
+
+    glDispatchCompute((numInstances + OCCLUSION_GROUP_SIZE - 1) / OCCLUSION_GROUP_SIZE, 1, 1);
+
+    //Drawn from next, and the second phase reads the first's rejections
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+
+  void Renderer::DrawCulledStaticMeshes(int phase, bool bDepthOnly)
+  {
+    (bDepthOnly ? m_shdDepth : m_shdStaticMesh).Use();
+
+    //Same batches as the queue, with instance counts and instances the culling pass wrote
+    m_instanceOffset = m_occlusionRanges.instances[phase];
+    IssueStaticDraws(m_viewDraws, m_occlusionBuffer, m_occlusionRanges.commands[phase], !bDepthOnly);
+  }
+
+  void Renderer::BuildHiZ()
+  {
+    m_shdHiZ.Use();
+
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texDepth);
+
+    GLsizei width = m_hiZWidth;
+    GLsizei height = m_hiZHeight;
+    for(GLint level = 0; level < m_hiZMips; ++level)
+    {
+      //The first level reads the depth buffer rather than the image
+      glBindImageTexture(0, m_texHiZ, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+      glBindImageTexture(1, m_texHiZ, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+      m_uniHiZ.level.Set(level);
+
+      glDispatchCompute((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+      width = std::max(width / 2, 1);
+      height = std::max(height / 2, 1);
+    }
+
+    //Sampled by the culling passes from here on
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    m_matHiZ = m_matProjection;
+    m_bHiZDrawn = true;
+  }
+
+  void Renderer::BindInstanceData(size_t first)
+  {
+    const uintptr_t base = m_instanceOffset + first * sizeof(InstanceData);
+
+    //A mat4 attribute takes one location per column
+    for(int col = 0; col < 4; ++col)
+    {
+      const uintptr_t offset = base + offsetof(InstanceData, pos) + col * sizeof(glm::vec4);
+      glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + col);
+      glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + col, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+      glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + col, 1);
+    }
+
+    const uintptr_t offset = base + offsetof(InstanceData, material);
+    glEnableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+    glVertexAttribIPointer(INSTANCE_MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)offset);
+    glVertexAttribDivisor(INSTANCE_MATERIAL_LOCATION, 1);
+  }
+
+  void Renderer::DrawMesh(const StaticMesh* mesh)
+  {
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh->m_iNumIndices, GL_UNSIGNED_INT,
+        (void*)(uintptr_t(mesh->m_iFirstIndex) * sizeof(GLuint)), mesh->m_iBaseVertex);
+  }
+
+  void Renderer::DrawAnimatedMeshes(bool bDepthOnly)
+  {
+    const MeshUniforms& uniforms = bDepthOnly ? m_uniAnimDepth : m_uniAnimatedMesh;
+    (bDepthOnly ? m_shdAnimDepth : m_shdAnimatedMesh).Use();
+
+    m_state.BindTexture(4, GL_TEXTURE_2D, m_texBonePalette);
+
+    if(!bDepthOnly)
+      m_meshesQueried = 0;
+
+    bool bFirst = true;
+    uint32_t lastTextureSet = 0;
+    const AnimatedMesh* pLastMesh = nullptr;
+    for(const DrawQueue::Entry& entry : m_animatedQueue)
+    {
+      const AnimatedMeshInstance& model = m_animatedMeshes[entry.index];
+      uniforms.matPos.Set(model.pos);
+      uniforms.firstBone.Set(model.firstBone);
+
+      const uint32_t material = model.materialId;
+      uniforms.material.Set(material);
+
+      //The queue is sorted so neighbouring draws often share state. Depth alone needs no textures.
+      const uint32_t textureSet = m_materialTextureSets[material];
+      if(!bDepthOnly)
+      {
+        if(bFirst || textureSet != lastTextureSet)
+          BindTextureSet(textureSet);
+        else
+          ++m_stateChangesSaved;
+      }
+
+      if(model.mesh != pLastMesh)
+        m_state.BindVertexArray(model.mesh->m_vaoConfig);
+      else
+        ++m_stateChangesSaved;
+
+      bFirst = false;
+      lastTextureSet = textureSet;
+      pLastMesh = model.mesh;
 
-      glBindVertexArray(model.mesh->m_vaoConfig);
+      //The GPU skips the draw if last frame's box was hidden, without the CPU ever reading the result
+      const bool bConditional = entry.index < m_meshQueries.size() && m_meshQueries[entry.index].bIssued &&
+        m_meshQueries[entry.index].mesh == model.mesh;
+      if(bConditional)
+      {
+        glBeginConditionalRender(m_meshQueries[entry.index].query, GL_QUERY_NO_WAIT);
+        if(!bDepthOnly)
+          ++m_meshesQueried;
+      }
 
       if(model.mesh->m_iNumIndices > 0)
       {
@@ -901,31 +1666,428 @@ namespace ne
       {
         glDrawArrays(GL_TRIANGLES, 0, model.mesh->m_iNumTris*3);
       }
+      ++m_drawCalls;
+
+      if(bConditional)
+        glEndConditionalRender();
+    }
+
+    m_state.BindVertexArray(0);
+  }
+
+  bool Renderer::IsQueried(size_t index) const
+  {
+    const AnimatedMesh* mesh = m_animatedMeshes[index].mesh;
+    const int numTris = mesh->m_iNumIndices > 0 ? mesh->m_iNumIndices / 3 : mesh->m_iNumTris;
+    if(numTris < OCCLUSION_QUERY_MIN_TRIANGLES)
+      return false;
+
+    //From inside the box the near plane clips it away, so it would always look hidden
+    const glm::vec3 extent = m_animatedBounds.Extent(index) + VIEW_NEAR_PLANE;
+    const glm::vec3 offset = glm::abs(m_viewPos - m_animatedBounds.Center(index));
+    return glm::any(glm::greaterThan(offset, extent));
+  }
+
+  void Renderer::DrawOcclusionQueries()
+  {
+    //Results are for the next frame only, anything not queried now draws unconditionally then
+    for(MeshQuery& query : m_meshQueries)
+      query.bIssued = false;
+    if(m_meshQueries.size() < m_animatedMeshes.size())
+      m_meshQueries.resize(m_animatedMeshes.size(), MeshQuery{nullptr, 0, false});
+
+    //Boxes only count samples, they leave colour and depth as they were
+    m_shdDebug.Use();
+    m_state.ColorMask(GL_FALSE);
+    m_state.DepthMask(GL_FALSE);
+    m_state.DepthFunc(GL_LESS);
+    m_state.Disable(GL_CULL_FACE);
+    m_state.BindVertexArray(m_pCube->m_vaoConfig);
+
+    for(const DrawQueue::Entry& entry : m_animatedQueue)
+    {
+      if(!IsQueried(entry.index))
+        continue;
+
+      MeshQuery& query = m_meshQueries[entry.index];
+      if(!query.query)
+        glGenQueries(1, &query.query);
+      query.mesh = m_animatedMeshes[entry.index].mesh;
+      query.bIssued = true;
+
+      //m_pCube spans -1 to 1, so scaling by the half extent fits it to the box
+      const glm::mat4 matBox = glm::scale(glm::translate(glm::mat4(1.0f), m_animatedBounds.Center(entry.index)),
+          m_animatedBounds.Extent(entry.index));
+      m_uniDebug.matPos.Set(matBox);
+
+      glBeginQuery(m_occlusionQueryTarget, query.query);
+      DrawMesh(m_pCube);
+      glEndQuery(m_occlusionQueryTarget);
+    }
+
+    m_state.BindVertexArray(0);
+    m_state.Enable(GL_CULL_FACE);
+    m_state.DepthMask(GL_TRUE);
+    m_state.ColorMask(GL_TRUE);
+  }
+
+  void Renderer::DrawPointLights()
+  {
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, m_compositeFBO);
+
+    for(size_t i = 0; i < m_pointLights.size(); ++i)
+    {
+      //Already shaded by DrawTiledPointLights
+      if(!m_pointLights[i].castShadows && m_bTiledLighting)
+        continue;
+
+      m_shdPointLight.Use();
+
+      m_state.BindTexture(0, GL_TEXTURE_2D, m_texLambert);
+
+      m_state.BindTexture(1, GL_TEXTURE_2D, m_texNormal);
+
+      m_state.BindTexture(2, GL_TEXTURE_2D, m_texPBRMaps);
+
+      m_state.BindTexture(3, GL_TEXTURE_2D, m_texDepth);
+
+      m_state.BindTexture(4, GL_TEXTURE_2D_ARRAY, m_texShadowCubes);
+
+      m_timers.Begin("Point Light", i);
+      BindLightBlock(i);
+      DrawLightVolume(m_shdPointLight, m_pSphere);
+      m_timers.End();
+    }
+  }
+
+  void Renderer::DrawTiledPointLights()
+  {
+    m_tiledLightsDrawn = 0;
+    if(!m_bTiledLighting)
+      return;
+
+    m_tiledLightData.clear();
+    for(const PointLight& light : m_pointLights)
+    {
+      if(light.castShadows)
+        continue;
+
+      const float radius = CalcLightRadius(light.radius, light.color, light.brightness);
+      m_tiledLightData.push_back(glm::vec4(light.pos, radius));
+      m_tiledLightData.push_back(glm::vec4(light.color, light.brightness));
+    }
+
+    m_tiledLightsDrawn = m_tiledLightData.size() / 2;
+    if(m_tiledLightData.empty())
+      return;
+
+    const size_t size = m_tiledLightData.size() * sizeof(glm::vec4);
+    const GLintptr offset = m_stream.Push(m_tiledLightData.data(), size, m_storageAlignment);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, m_stream.Buffer(), offset, size);
+
+    m_shdTiledLights.Use();
+
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texLambert);
+
+    m_state.BindTexture(1, GL_TEXTURE_2D, m_texNormal);
+
+    m_state.BindTexture(2, GL_TEXTURE_2D, m_texDepth);
+
+    if(m_bCompactGBuffer)
+      glBindImageTexture(1, m_texComposite, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+    else
+      glBindImageTexture(0, m_texComposite, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    m_uniTiledLights.numLights.Set(m_tiledLightsDrawn);
+
+    glDispatchCompute(
+        (m_width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE,
+        (m_height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE,
+        1);
+
+    //The remaining lights blend on top of the image writes, and compositing samples the result
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+
+  void Renderer::DrawDirectionalLights()
+  {
+    m_shdDirectionalLight.Use();
+
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texLambert);
+
+    m_state.BindTexture(1, GL_TEXTURE_2D, m_texNormal);
+
+    m_state.BindTexture(2, GL_TEXTURE_2D, m_texPBRMaps);
+
+    m_state.BindTexture(3, GL_TEXTURE_2D, m_texDepth);
+
+    const size_t firstBlock = m_pointLights.size() + m_spotLights.size();
+
+    m_state.BindVertexArray(m_pPlane->m_vaoConfig);
+    for(size_t i = 0; i < m_directionalLights.size(); ++i)
+    {
+      m_timers.Begin("Directional Light", i);
+      BindLightBlock(firstBlock + i);
+      DrawMesh(m_pPlane);
+      m_timers.End();
+    }
+    m_state.BindVertexArray(0);
+  }
+
+  void Renderer::DrawSpotLights()
+  {
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, m_compositeFBO);
+
+    for(size_t i = 0; i < m_spotLights.size(); ++i)
+    {
+      m_shdSpotLight.Use();
+
+      m_state.BindTexture(0, GL_TEXTURE_2D, m_texLambert);
+
+      m_state.BindTexture(1, GL_TEXTURE_2D, m_texNormal);
+
+      m_state.BindTexture(2, GL_TEXTURE_2D, m_texPBRMaps);
+
+      m_state.BindTexture(3, GL_TEXTURE_2D, m_texDepth);
+
+      m_state.BindTexture(4, GL_TEXTURE_2D, m_texShadowAtlas);
+
+      m_timers.Begin("Spot Light", i);
+      BindLightBlock(m_pointLights.size() + i);
+      DrawLightVolume(m_shdSpotLight, m_pCone);
+      m_timers.End();
+    }
+  }
+
+  void Renderer::CreateShadowMaps()
+  {
+    if(m_texShadowAtlas)
+      m_state.DeleteTextures(1, &m_texShadowAtlas);
+    if(m_texShadowCubes)
+      m_state.DeleteTextures(1, &m_texShadowCubes);
+
+    //Every spot light's shadow map is a tile of this, so all of them are drawn before any lighting
+    glGenTextures(1, &m_texShadowAtlas);
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texShadowAtlas);
+    glTexImage2D(
+        GL_TEXTURE_2D,
+        0, m_shadowFormat,
+        SHADOW_ATLAS_SIZE,
+        SHADOW_ATLAS_SIZE,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        NULL);
+    //Samples outside a light's tile are rejected by spotlight_frag, not by a border
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, m_shadowFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_texShadowAtlas, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    //Point light shadow maps, six layers per light in cube face order. An array of
+    //2D layers rather than a cube map array, which GLSL ES 3.00 can't sample.
+    glGenTextures(1, &m_texShadowCubes);
+    m_state.BindTexture(0, GL_TEXTURE_2D_ARRAY, m_texShadowCubes);
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0, m_shadowFormat,
+        SHADOW_LAYER_SIZE,
+        SHADOW_LAYER_SIZE,
+        MAX_POINT_SHADOWS * 6,
+        0,
+        GL_DEPTH_COMPONENT,
+        GL_FLOAT,
+        NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, m_shadowCubeFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texShadowCubes, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    //Return to default framebuffer
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    //Cached maps are copied into these, so they have to share a format
+    m_shadowCache.Init(m_shadowFormat, MAX_CACHED_SPOT_SHADOWS, MAX_CACHED_POINT_SHADOWS);
+  }
+
+  void Renderer::DrawShadowMaps()
+  {
+    NE_PROFILE_ZONE("Renderer::DrawShadowMaps");
+    m_state.DepthMask(GL_TRUE);
+    m_state.DepthFunc(GL_LESS);
+
+    //Each light draws into its own part of these, so they are cleared once for all of them
+    if(m_numSpotShadows > 0)
+    {
+      m_state.BindFramebuffer(GL_FRAMEBUFFER, m_shadowFBO);
+      glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    if(m_numPointShadows > 0)
+    {
+      m_state.BindFramebuffer(GL_FRAMEBUFFER, m_shadowCubeFBO);
+      glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    //Recorded in light block order, point lights then spot lights
+    for(const ShadowCommands& commands : m_shadowCommands)
+    {
+      const LightBlock& block = LightBlockAt(commands.block);
+      if(commands.bCube)
+      {
+        m_timers.Begin("Point Shadow", commands.block);
+        DrawPointShadowMap(block, commands);
+      }
+      else
+      {
+        m_timers.Begin("Spot Shadow", commands.block - m_pointLights.size());
+        DrawSpotShadowMap(block, commands);
+      }
+      m_timers.End();
+    }
+
+    m_state.DepthMask(GL_FALSE);
+    m_state.Viewport(0, 0, m_width, m_height);
+  }
+
+  void Renderer::DrawSpotShadowMap(const LightBlock& block, const ShadowCommands& commands)
+  {
+    const glm::mat4& lightProj = commands.lightTransforms[0];
+
+    //The light's tile in texels
+    const ShadowSlot slot = {
+      m_shadowFBO,
+      m_texShadowAtlas,
+      GLint(block.shadowRect.x * SHADOW_ATLAS_SIZE + 0.5f),
+      GLint(block.shadowRect.y * SHADOW_ATLAS_SIZE + 0.5f),
+      0,
+      commands.size
+    };
+    m_shadowTexels += slot.size * slot.size;
+
+    m_shdShadows.Use();
+    m_uniShadows.matLightProj.Set(lightProj);
+    DrawStaticShadowCasters(commands, slot, m_uniShadows);
+
+    m_shdAnimShadows.Use();
+    m_uniAnimShadows.matLightProj.Set(lightProj);
+    DrawShadowCasters(commands, true, slot, m_uniAnimShadows);
+  }
+
+  void Renderer::DrawPointShadowMap(const LightBlock& block, const ShadowCommands& commands)
+  {
+    const ShadowSlot slot = {m_shadowCubeFBO, m_texShadowCubes, 0, 0, block.shadowLayer, commands.size};
+    m_shadowTexels += 6 * slot.size * slot.size;
+
+    m_shdCubeShadows.Use();
+    m_uniCubeShadows.matLightPos.Set(commands.lightTransforms, 6);
+    m_uniCubeShadows.lightPos.Set(block.pos);
+    m_uniCubeShadows.farPlane.Set(block.farPlane);
+    DrawStaticShadowCasters(commands, slot, m_uniCubeShadows);
+
+    m_shdAnimCubeShadows.Use();
+    m_uniAnimCubeShadows.matLightPos.Set(commands.lightTransforms, 6);
+    m_uniAnimCubeShadows.lightPos.Set(block.pos);
+    m_uniAnimCubeShadows.farPlane.Set(block.farPlane);
+    DrawShadowCasters(commands, true, slot, m_uniAnimCubeShadows);
+  }
 
-      glBindVertexArray(0);
+  void Renderer::DrawStaticShadowCasters(const ShadowCommands& commands, const ShadowSlot& slot, const ShadowUniforms& uniforms)
+  {
+    ShadowCache::Entry* pCached = m_bShadowCache ? m_shadowCache.Find(commands.lightKey, commands.bCube, slot.size) : nullptr;
+    if(!pCached)
+    {
+      DrawShadowCasters(commands, false, slot, uniforms);
+      return;
+    }
+
+    if(pCached->bValid && pCached->casterHash == commands.casterHash)
+    {
+      ++m_shadowMapsCached;
     }
+    else
+    {
+      m_state.BindFramebuffer(GL_FRAMEBUFFER, pCached->fbo);
+      glClear(GL_DEPTH_BUFFER_BIT);
+      const ShadowSlot cacheSlot = {pCached->fbo, pCached->texture, 0, 0, 0, slot.size};
+      m_shadowTexels += (commands.bCube ? 6 : 1) * slot.size * slot.size;
+      DrawShadowCasters(commands, false, cacheSlot, uniforms);
+      pCached->casterHash = commands.casterHash;
+      pCached->bValid = true;
+    }
+
+    //Lighting only reads the atlas and array, so the cached map is copied into the light's slot
+    //and any moving casters go on top, leaving the cache with just the static casters
+    const GLenum target = commands.bCube ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    glCopyImageSubData(pCached->texture, target, 0, 0, 0, 0,
+        slot.texture, target, 0, slot.x, slot.y, slot.layer,
+        slot.size, slot.size, commands.bCube ? 6 : 1);
+  }
+
+  void Renderer::DrawShadowCasters(const ShadowCommands& commands, bool bAnimated, const ShadowSlot& slot, const ShadowUniforms& uniforms)
+  {
+    for(const ShadowPass& pass : commands.passes)
+    {
+      const size_t numDraws = bAnimated ? pass.animatedDraws.size() : pass.staticDraws.instances.size();
+      if(numDraws == 0)
+        continue;
+
+      if(pass.face < 0)
+      {
+        BindShadowSlot(slot, uniforms);
+      }
+      else
+      {
+        m_state.BindFramebuffer(GL_FRAMEBUFFER, m_shadowFaceFBO);
+        m_state.Viewport(slot.x, slot.y, slot.size, slot.size);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, slot.texture, 0, slot.layer + pass.face);
+      }
 
-    glUseProgram(m_shdAnimCubeShadows);
+      m_shadowCastersDrawn += numDraws;
+      if(bAnimated)
+        DrawAnimatedShadowQueue(pass.animatedDraws, uniforms);
+      else
+        DrawStaticList(pass.staticDraws, false);
+    }
+  }
 
-    glUniformMatrix4fv(glGetUniformLocation(m_shdAnimCubeShadows, "matLightPos"), 6, GL_FALSE, &lightTransforms[0][0][0]);
+  void Renderer::BindShadowSlot(const ShadowSlot& slot, const ShadowUniforms& uniforms)
+  {
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, slot.fbo);
+    m_state.Viewport(slot.x, slot.y, slot.size, slot.size);
+    uniforms.firstLayer.Set(slot.layer);
+  }
 
-    glUniformMatrix4fv(glGetUniformLocation(m_shdAnimCubeShadows, "matLightProj"), 1, GL_FALSE, &identity[0][0]);
+  void Renderer::DrawAnimatedShadowQueue(const std::vector<DrawQueue::Entry>& draws, const ShadowUniforms& uniforms)
+  {
+    if(draws.empty())
+      return;
 
-    glUniform3f(glGetUniformLocation(m_shdAnimCubeShadows, "lightPos"), position.x, position.y, position.z);
-    glUniform1f(glGetUniformLocation(m_shdAnimCubeShadows, "farPlane"), (float)farPlane);
-    const GLint animMatPosLoc = glGetUniformLocation(m_shdAnimCubeShadows, "matPos");
-    const GLint matBonesLoc = glGetUniformLocation(m_shdAnimCubeShadows, "boneTransforms");
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texBonePalette);
 
-    for(auto& model : m_animatedMeshes)
+    const AnimatedMesh* pLastAnimMesh = nullptr;
+    for(const DrawQueue::Entry& entry : draws)
     {
-      glUniformMatrix4fv(animMatPosLoc, 1, GL_FALSE, &model.pos[0][0]);
-      glUniformMatrix4fv(
-          matBonesLoc,
-          model.boneTransforms->size(),
-          GL_FALSE,
-          &model.boneTransforms->data()[0][0][0]);
+      const AnimatedMeshInstance& model = m_animatedMeshes[entry.index];
+      uniforms.matPos.Set(model.pos);
+      uniforms.firstBone.Set(model.firstBone);
+      uniforms.face.Set(entry.layer);
 
-      glBindVertexArray(model.mesh->m_vaoConfig);
+      if(model.mesh != pLastAnimMesh)
+        m_state.BindVertexArray(model.mesh->m_vaoConfig);
+      else
+        ++m_stateChangesSaved;
+      pLastAnimMesh = model.mesh;
 
       if(model.mesh->m_iNumIndices > 0)
       {
@@ -935,27 +2097,57 @@ namespace ne
       {
         glDrawArrays(GL_TRIANGLES, 0, model.mesh->m_iNumTris*3);
       }
-
-      glBindVertexArray(0);
+      ++m_drawCalls;
     }
 
-    glViewport(0, 0, m_width, m_height);
+    m_state.BindVertexArray(0);
+  }
+
+  void Renderer::DrawLightVolume(const Program& program, const StaticMesh* mesh)
+  {
+    //Volumes may poke through the near and far planes, don't let them be clipped
+    m_state.Enable(GL_DEPTH_CLAMP);
+    m_state.BindVertexArray(mesh->m_vaoConfig);
+
+    //Mark pixels whose geometry is inside the volume: the back faces are behind it
+    //but the front faces are not, so the stencil ends up non-zero
+    m_shdLightStencil.Use();
+
+    m_state.ColorMask(GL_FALSE);
+    m_state.Disable(GL_CULL_FACE);
+    m_state.DepthFunc(GL_LESS);
+    m_state.Enable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+    DrawMesh(mesh);
+
+    //Light the marked pixels once each, clearing the stencil for the next light
+    program.Use();
+
+    m_state.ColorMask(GL_TRUE);
+    m_state.Enable(GL_CULL_FACE);
+    m_state.CullFace(GL_FRONT);
+    m_state.DepthFunc(GL_ALWAYS);
+    glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+    DrawMesh(mesh);
+
+    m_state.BindVertexArray(0);
+    m_state.CullFace(GL_BACK);
+    m_state.Disable(GL_STENCIL_TEST);
+    m_state.Disable(GL_DEPTH_CLAMP);
   }
 
   void Renderer::DrawDebugMesh(const StaticMesh* mesh, const DebugInstance &instance)
   {
-    glUseProgram(m_shdDebug);
-    glUniformMatrix4fv(glGetUniformLocation(m_shdDebug, "matView"), 1, GL_FALSE, &m_matProjection[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(m_shdDebug, "matPos"), 1, GL_FALSE, &instance.pos[0][0]);
-    glUniform3f(glGetUniformLocation(m_shdDebug, "color"), instance.color.x, instance.color.y, instance.color.z);
+    m_shdDebug.Use();
+    m_uniDebug.matPos.Set(instance.pos);
+    m_uniDebug.color.Set(instance.color);
 
-    glBindVertexArray(mesh->m_vaoConfig);
-    if(mesh->m_iNumIndices > 0) {
-      glDrawElements(GL_TRIANGLES, mesh->m_iNumIndices, GL_UNSIGNED_INT, 0);
-    } else {
-      glDrawArrays(GL_TRIANGLES, 0, mesh->m_iNumTris*3);
-    }
-    glBindVertexArray(0);
+    m_state.BindVertexArray(mesh->m_vaoConfig);
+    DrawMesh(mesh);
+    m_state.BindVertexArray(0);
   }
 
   void Renderer::AddPointLight(const PointLight& light)
@@ -988,51 +2180,72 @@ namespace ne
     m_curTime += dt;
   }
 
-  GLuint Renderer::LoadShader(const std::string &vsPath, const std::string &fsPath, const std::string &gsPath)
+  void Renderer::MeshUniforms::Find(const Program& program)
+  {
+    matPos = program.Get<glm::mat4>("matPos");
+    firstBone = program.Get<GLint>("firstBone");
+    material = program.Get<GLuint>("material");
+    color = program.Get<glm::vec3>("color");
+  }
+
+  void Renderer::ShadowUniforms::Find(const Program& program)
+  {
+    matLightProj = program.Get<glm::mat4>("matLightProj");
+    matLightPos = program.Get<glm::mat4>("matLightPos");
+    matPos = program.Get<glm::mat4>("matPos");
+    firstBone = program.Get<GLint>("firstBone");
+    lightPos = program.Get<glm::vec3>("lightPos");
+    farPlane = program.Get<float>("farPlane");
+    firstLayer = program.Get<GLint>("firstLayer");
+    face = program.Get<GLint>("face");
+  }
+
+  void Renderer::ScreenUniforms::Find(const Program& program)
+  {
+    lightColor = program.Get<glm::vec3>("lightColor");
+    gamma = program.Get<float>("gamma");
+    exposure = program.Get<float>("exposure");
+    numLights = program.Get<GLuint>("numLights");
+  }
+
+  void Renderer::CullUniforms::Find(const Program& program)
+  {
+    matViewProj = program.Get<glm::mat4>("matViewProj");
+    numInstances = program.Get<GLuint>("numInstances");
+    phase = program.Get<GLint>("phase");
+    hiZLevels = program.Get<GLint>("hiZLevels");
+    level = program.Get<GLint>("level");
+  }
+
+  Program Renderer::LoadShader(const std::string &vsPath, const std::string &fsPath, const std::string &gsPath)
   {
     //Read the sources
-    std::vector<char> vSrc(4096);
+    std::string vSrc;
+    if(!ReadShaderSource(vsPath, vSrc))
     {
-      std::ifstream vsIs(vsPath, std::ios::in);
-      if(!vsIs.is_open())
-      {
-        std::cerr << "Could not open vertex shader: " << vsPath << std::endl;
-        return 0;
-      }
-      vsIs.read(&vSrc[0], vSrc.size());
-      vsIs.close();
+      std::cerr << "Could not open vertex shader: " << vsPath << std::endl;
+      return Program();
     }
 
-    std::vector<char> fSrc(4096);
+    std::string fSrc;
+    if(!ReadShaderSource(fsPath, fSrc))
     {
-      std::ifstream fsIs(fsPath, std::ios::in);
-      if(!fsIs.is_open())
-      {
-        std::cerr << "Could not open fragment shader: " << fsPath << std::endl;
-        return 0;
-      }
-      fsIs.read(&fSrc[0], fSrc.size());
-      fsIs.close();
+      std::cerr << "Could not open fragment shader: " << fsPath << std::endl;
+      return Program();
     }
 
-    std::vector<char> gSrc(4096);
-    if(!gsPath.empty())
+    std::string gSrc;
+    if(!gsPath.empty() && !ReadShaderSource(gsPath, gSrc))
     {
-      std::ifstream gsIs(gsPath, std::ios::in);
-      if(!gsIs.is_open())
-      {
-        std::cerr << "Could not open geometry shader: " << gsPath << std::endl;
-        return 0;
-      }
-      gsIs.read(&gSrc[0], gSrc.size());
-      gsIs.close();
+      std::cerr << "Could not open geometry shader: " << gsPath << std::endl;
+      return Program();
     }
 
     //Build the shaders
     GLint status;
 
     GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    const char *vSrcPtr = &vSrc[0];
+    const char *vSrcPtr = vSrc.c_str();
     glShaderSource(vs, 1, &vSrcPtr, NULL);
     glCompileShader(vs);
     glGetShaderiv(vs, GL_COMPILE_STATUS, &status);
@@ -1044,11 +2257,11 @@ namespace ne
       glGetShaderInfoLog(vs, logLen, NULL, &vLog[0]);
       std::cerr << vsPath << " failed to compile: " << &vLog[0] << std::endl;
       glDeleteShader(vs);
-      return 0;
+      return Program();
     }
 
     GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    const char *fSrcPtr = &fSrc[0];
+    const char *fSrcPtr = fSrc.c_str();
     glShaderSource(fs, 1, &fSrcPtr, NULL);
     glCompileShader(fs);
     glGetShaderiv(fs, GL_COMPILE_STATUS, &status);
@@ -1061,14 +2274,14 @@ namespace ne
       std::cerr << fsPath << " failed to compile: " << &fLog[0] << std::endl;
       glDeleteShader(vs);
       glDeleteShader(fs);
-      return 0;
+      return Program();
     }
 
     GLuint gs = 0;
-    if(gSrc[0])
+    if(!gSrc.empty())
     {
       gs = glCreateShader(GL_GEOMETRY_SHADER);
-      const char *gSrcPtr = &gSrc[0];
+      const char *gSrcPtr = gSrc.c_str();
       glShaderSource(gs, 1, &gSrcPtr, NULL);
       glCompileShader(gs);
       glGetShaderiv(gs, GL_COMPILE_STATUS, &status);
@@ -1082,7 +2295,7 @@ namespace ne
         glDeleteShader(vs);
         glDeleteShader(fs);
         glDeleteShader(gs);
-        return 0;
+        return Program();
       }
     }
 
@@ -1111,64 +2324,128 @@ namespace ne
     glDeleteShader(vs);
     glDeleteShader(fs);
     glDeleteShader(gs);
-    return prog;
+    return Program(prog);
+  }
+
+  Program Renderer::LoadComputeShader(const std::string &csPath)
+  {
+    //Read the source
+    std::string cSrc;
+    if(!ReadShaderSource(csPath, cSrc))
+    {
+      std::cerr << "Could not open compute shader: " << csPath << std::endl;
+      return Program();
+    }
+
+    //Build the shader
+    GLint status;
+
+    GLuint cs = glCreateShader(GL_COMPUTE_SHADER);
+    const char *cSrcPtr = cSrc.c_str();
+    glShaderSource(cs, 1, &cSrcPtr, NULL);
+    glCompileShader(cs);
+    glGetShaderiv(cs, GL_COMPILE_STATUS, &status);
+    if(status != GL_TRUE)
+    {
+      GLint logLen;
+      glGetShaderiv(cs, GL_INFO_LOG_LENGTH, &logLen);
+      std::vector<char> cLog(logLen);
+      glGetShaderInfoLog(cs, logLen, NULL, &cLog[0]);
+      std::cerr << csPath << " failed to compile: " << &cLog[0] << std::endl;
+      glDeleteShader(cs);
+      return Program();
+    }
+
+    // Link the program
+    GLuint prog = glCreateProgram();
+    glAttachShader(prog, cs);
+    glLinkProgram(prog);
+
+    // Check the program
+    glGetProgramiv(prog, GL_LINK_STATUS, &status);
+    if(status != GL_TRUE)
+    {
+      GLint logLen;
+      glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &logLen);
+      std::vector<char> pLog(logLen > 0 ? logLen : 1);
+      glGetProgramInfoLog(prog, logLen, NULL, &pLog[0]);
+      std::cerr << "Shader failed to link: " << &pLog[0] << std::endl;
+      glDeleteProgram(prog);
+      prog = 0;
+    }
+
+    glDeleteShader(cs);
+    return Program(prog);
   }
 
   void Renderer::SetupGeometryPass()
   {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glEnable(GL_CULL_FACE);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
-    glDisable(GL_BLEND);
-    glDepthFunc(GL_LESS);
+    m_state.PolygonMode(GL_FILL);
+    m_state.Enable(GL_CULL_FACE);
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
+    m_state.Disable(GL_BLEND);
+    m_state.DepthMask(GL_TRUE);
+    m_state.DepthFunc(GL_LESS);
     glClearColor(0.0,0.0,0.0,1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   }
 
+  void Renderer::SetupDepthPrePass()
+  {
+    m_state.ColorMask(GL_FALSE);
+  }
+
+  void Renderer::SetupGBufferPass()
+  {
+    //Only the fragment that won the pre-pass is shaded, and depth is already final
+    m_state.ColorMask(GL_TRUE);
+    m_state.DepthMask(GL_FALSE);
+    m_state.DepthFunc(GL_EQUAL);
+  }
+
   void Renderer::SetupLightPass()
   {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_compositeFBO);
+    //Light volumes are depth tested against the geometry, so bring its depth across
+    m_state.BindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_compositeFBO);
+    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
     glClearColor(0.0,0.0,0.0,1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_BLEND);
-    glDepthFunc(GL_ALWAYS);
-    glBlendFunc(GL_ONE, GL_ONE);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    m_state.DepthMask(GL_FALSE);
+    m_state.Enable(GL_BLEND);
+    m_state.DepthFunc(GL_ALWAYS);
+    m_state.BlendFunc(GL_ONE, GL_ONE);
   }
 
   void Renderer::SetupDebugPass()
   {
-    glDisable(GL_CULL_FACE);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glDepthFunc(GL_LESS);
-    glDisable(GL_BLEND);
+    m_state.Disable(GL_CULL_FACE);
+    m_state.PolygonMode(GL_LINE);
+    m_state.DepthFunc(GL_LESS);
+    m_state.Disable(GL_BLEND);
   }
 
   void Renderer::CompositeFrame()
   {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_outputFBO);
+    m_state.DepthMask(GL_TRUE); //The compositor writes the geometry depth for the debug pass
     glClearColor(0.0,0.0,0.0,1);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(m_shdCompositor);
+    m_shdCompositor.Use();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_texComposite);
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texComposite);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_texDepth);
+    m_state.BindTexture(1, GL_TEXTURE_2D, m_texDepth);
 
-    glUniform1i(glGetUniformLocation(m_shdCompositor, "sampBuffer"), 0);
-    glUniform1i(glGetUniformLocation(m_shdCompositor, "sampDepth"), 1);
+    m_uniCompositor.gamma.Set(m_gamma);
+    m_uniCompositor.exposure.Set(m_exposure);
 
-    glUniform1f(glGetUniformLocation(m_shdCompositor, "gamma"), m_gamma);
-    glUniform1f(glGetUniformLocation(m_shdCompositor, "exposure"), m_exposure);
-    glUniform2f(glGetUniformLocation(m_shdCompositor, "screenSize"), (float)m_width, (float)m_height);
-
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, m_pPlane->m_vboVertices);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, m_pPlane->m_iStride, (void*)m_pPlane->m_iOffPos);
-    glDrawArrays(GL_TRIANGLES, 0, m_pPlane->m_iNumTris*3);
-    glDisableVertexAttribArray(0);
+    m_state.BindVertexArray(m_pPlane->m_vaoConfig);
+    DrawMesh(m_pPlane);
+    m_state.BindVertexArray(0);
   }
 
   void Renderer::SetGlobalIllumination(glm::vec3 color)
@@ -1181,6 +2458,129 @@ namespace ne
     m_gamma = gamma;
   }
 
+  bool Renderer::CreateGBuffer()
+  {
+    //Bound while the old targets go, so they are detached along with them
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
+    if(m_texNormal)
+      m_state.DeleteTextures(1, &m_texNormal);
+    if(m_texPBRMaps)
+      m_state.DeleteTextures(1, &m_texPBRMaps);
+    m_texPBRMaps = 0;
+
+    if(m_bCompactGBuffer)
+    {
+      //Octahedral normal in red and green, roughness in blue
+      m_texNormal = GenerateBuffer(GL_RGB10_A2, GL_RGBA, GL_COLOR_ATTACHMENT1, m_width, m_height, GL_UNSIGNED_INT_2_10_10_10_REV);
+    }
+    else
+    {
+      m_texNormal = GenerateBuffer(GL_RGB16F, GL_RGB, GL_COLOR_ATTACHMENT1, m_width, m_height);
+      m_texPBRMaps = GenerateBuffer(GL_RG16F, GL_RG, GL_COLOR_ATTACHMENT2, m_width, m_height);
+    }
+
+    GLenum drawBuffers[] = {
+      GL_COLOR_ATTACHMENT0,
+      GL_COLOR_ATTACHMENT1,
+      m_bCompactGBuffer ? GLenum(GL_NONE) : GLenum(GL_COLOR_ATTACHMENT2)
+    };
+    glDrawBuffers(sizeof drawBuffers / sizeof drawBuffers[0], drawBuffers);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      return false;
+
+    m_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, m_compositeFBO);
+    if(m_texComposite)
+      m_state.DeleteTextures(1, &m_texComposite);
+
+    //Both can be bound as an image by the tiled light pass, R11G11B10F as raw 32 bit texels
+    if(m_bCompactGBuffer)
+      m_texComposite = GenerateBuffer(GL_R11F_G11F_B10F, GL_RGB, GL_COLOR_ATTACHMENT0, m_width, m_height);
+    else
+      m_texComposite = GenerateBuffer(GL_RGBA16F, GL_RGBA, GL_COLOR_ATTACHMENT0, m_width, m_height);
+
+    GLenum compositeBuffers[] = {
+      GL_COLOR_ATTACHMENT0,
+    };
+    glDrawBuffers(sizeof compositeBuffers / sizeof compositeBuffers[0], compositeBuffers);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      return false;
+
+    //Return to default framebuffer
+    m_state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+  }
+
+  void Renderer::SetCompactGBuffer(bool bCompact)
+  {
+    if(m_bIsMidFrame || bCompact == m_bCompactGBuffer)
+      return;
+
+    m_bCompactGBuffer = bCompact;
+    if(m_bIsInit && !CreateGBuffer())
+    {
+      std::cerr << "Could not create the compact g buffer, keeping the full one" << std::endl;
+      m_bCompactGBuffer = false;
+      CreateGBuffer();
+    }
+  }
+
+  void Renderer::SetShadowDepthBits(int bits)
+  {
+    const GLenum format = bits > 16 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16;
+    if(format == m_shadowFormat)
+      return;
+
+    //Maps already made are remade in the new format
+    m_shadowFormat = format;
+    if(m_bIsInit)
+      CreateShadowMaps();
+  }
+
+  void Renderer::SetDepthPrePass(bool bEnabled)
+  {
+    if(m_bIsMidFrame)
+      return;
+
+    m_bDepthPrePass = bEnabled;
+  }
+
+  void Renderer::SetOcclusionCulling(bool bEnabled)
+  {
+    if(m_bIsMidFrame)
+      return;
+
+    //The pyramid is only made where Init could build the culling shaders. One left stale while
+    //culling was off only costs the first frame back some draws, as its second phase retests them.
+    m_bOcclusionCulling = bEnabled && m_texHiZ != 0;
+  }
+
+  void Renderer::SetTiledLighting(bool bEnabled)
+  {
+    if(m_bIsMidFrame)
+      return;
+
+    m_bTiledLighting = bEnabled && m_shdTiledLights;
+  }
+
+  void Renderer::SetShadowCache(bool bEnabled)
+  {
+    if(m_bIsMidFrame)
+      return;
+
+    //Entries are checked against their casters before use, so nothing goes stale while it is off
+    m_bShadowCache = bEnabled && m_bCopyImage;
+  }
+
+  void Renderer::SetOutputFramebuffer(GLuint fbo)
+  {
+    if(m_bIsMidFrame)
+      return;
+
+    m_outputFBO = fbo;
+  }
+
   void Renderer::SetExposure(float exposure)
   {
     m_exposure = exposure;
@@ -1189,22 +2589,14 @@ namespace ne
   void Renderer::ApplyGlobalIllumination()
   {
 
-    glUseProgram(m_shdGlobalIllum);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_texLambert);
-
-    glUniform2f(glGetUniformLocation(m_shdGlobalIllum, "screenSize"), (float)m_width, (float)m_height);
-    glUniform1i(glGetUniformLocation(m_shdGlobalIllum, "sampColor"), 0);
-    glUniform3f(glGetUniformLocation(m_shdGlobalIllum, "lightColor"), (float)m_globalIllumColor.x, (float)m_globalIllumColor.y, (float)m_globalIllumColor.z);
+    m_shdGlobalIllum.Use();
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, m_pPlane->m_vboVertices);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, m_pPlane->m_iStride, (void*)m_pPlane->m_iOffPos);
+    m_state.BindTexture(0, GL_TEXTURE_2D, m_texLambert);
 
-    glDrawArrays(GL_TRIANGLES, 0, m_pPlane->m_iNumTris*3);
+    m_uniGlobalIllum.lightColor.Set(m_globalIllumColor);
 
-    glDisableVertexAttribArray(0);
-    glClear(GL_DEPTH_BUFFER_BIT);
+    m_state.BindVertexArray(m_pPlane->m_vaoConfig);
+    DrawMesh(m_pPlane);
+    m_state.BindVertexArray(0);
   }
 }
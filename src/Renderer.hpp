@@ -1,10 +1,19 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include "OpenGL.hpp"
+#include "CullingBatch.hpp"
+#include "DrawQueue.hpp"
+#include "GpuTimers.hpp"
+#include "JobSystem.hpp"
+#include "Program.hpp"
+#include "ShadowCache.hpp"
+#include "StreamBuffer.hpp"
 
 namespace ne
 {
@@ -12,33 +21,41 @@ namespace ne
   class AnimatedMesh;
   class Material;
   class Texture;
+  class GLState;
 
   struct StaticMeshInstance
   {
     StaticMeshInstance(StaticMesh* pMesh, Material* pMat, glm::mat4 position)
-      : mesh(pMesh), mat(pMat), pos(position) {};
+      : mesh(pMesh), mat(pMat), pos(position), meshId(0), materialId(0) {};
     StaticMesh* mesh;
     Material* mat;
     glm::mat4 pos;
+    //Given out before commands are recorded, so recording only reads them
+    uint32_t meshId;
+    uint32_t materialId; //Only for visible instances
   };
 
   struct AnimatedMeshInstance
   {
-    AnimatedMeshInstance(AnimatedMesh* pMesh, Material* pMat, glm::mat4 position, const std::vector<glm::mat4> *boneTransforms)
-      : mesh(pMesh), mat(pMat), pos(position), boneTransforms(boneTransforms) {};
+    AnimatedMeshInstance(AnimatedMesh* pMesh, Material* pMat, glm::mat4 position, uint32_t firstBone)
+      : mesh(pMesh), mat(pMat), pos(position), firstBone(firstBone), meshId(0), materialId(0) {};
     AnimatedMesh* mesh;
     Material* mat;
     glm::mat4 pos;
-    const std::vector<glm::mat4> *boneTransforms;
+    uint32_t firstBone; //Into the frame's bone palette
+    uint32_t meshId;
+    uint32_t materialId;
   };
 
   struct PointLight
   {
-    PointLight(glm::vec3 pos, glm::vec3 color, float brightness)
-      : pos(pos), color(color), brightness(brightness) {};
+    PointLight(glm::vec3 pos, glm::vec3 color, float brightness, float radius = 0.0f, bool castShadows = true)
+      : pos(pos), color(color), brightness(brightness), radius(radius), castShadows(castShadows) {};
     glm::vec3 pos;
     glm::vec3 color;
     float brightness;
+    float radius; //Distance the light reaches, 0 to derive it from brightness
+    bool castShadows; //Unshadowed lights are cheap and shaded together in screen tiles
   };
 
   struct DirectionalLight
@@ -52,19 +69,21 @@ namespace ne
 
   struct SpotLight
   {
-    SpotLight(glm::vec3 pos, glm::vec3 dir, float innerAngle, float outerAngle, glm::vec3 color, float brightness)
+    SpotLight(glm::vec3 pos, glm::vec3 dir, float innerAngle, float outerAngle, glm::vec3 color, float brightness, float radius = 0.0f)
       : pos(pos)
       , dir(dir)
       , innerAngle(innerAngle)
       , outerAngle(outerAngle)
       , color(color)
-      , brightness(brightness) {};
+      , brightness(brightness)
+      , radius(radius) {};
     glm::vec3 pos;
     glm::vec3 dir;
     float innerAngle;
     float outerAngle;
     glm::vec3 color;
     float brightness;
+    float radius; //Distance the light reaches, 0 to derive it from brightness
   };
 
   struct DebugInstance
@@ -78,11 +97,23 @@ namespace ne
   struct FrameStats
   {
     double totalTime;
+    double depthPrePassTime; //0 unless the depth pre-pass is on
     double geometryTime;
     double lightingTime;
     double shadowTime;
     double compositeTime;
     double debugTime;
+    int meshesDrawn; //Instances that passed frustum culling
+    int meshesCulled; //Instances rejected by frustum culling
+    int meshesQueried; //Heavy animated instances drawn only if last frame's bounding box query saw them
+    int shadowCastersDrawn; //Instances drawn into shadow maps, summed over all lights and cube faces
+    int shadowMapsCached; //Shadow maps whose static casters were reused from an earlier frame
+    int shadowTexels; //Shadow map texels drawn into, not counting cached maps that were reused
+    int tiledLights; //Unshadowed point lights shaded by the tiled compute pass
+    int stateChangesSaved; //Material and mesh binds skipped because the previous draw shared them
+    int drawCalls; //Draw calls issued by the geometry and shadow passes
+    int stateFiltered; //Binds and state changes GLState dropped because they were already in effect
+    std::vector<GpuScope> gpuScopes; //Every pass and light the times above were summed from
   };
 
   class Renderer
@@ -100,9 +131,24 @@ namespace ne
     void SetGlobalIllumination(glm::vec3 color);
     void SetGamma(float gamma);
     void SetExposure(float exposure);
+    void SetShadowDepthBits(int bits); //16 or 24
+    //Draw depth alone before the g buffers, worth it when overdraw is high
+    void SetDepthPrePass(bool bEnabled);
+    //Test static meshes against a depth pyramid before drawing them, on by default where compute shaders work
+    void SetOcclusionCulling(bool bEnabled);
+    //Shade unshadowed point lights per screen tile in one compute pass rather than as volumes, on where supported
+    void SetTiledLighting(bool bEnabled);
+    //Keep each light's static casters in a map of their own and redraw only the moving ones, on where supported
+    void SetShadowCache(bool bEnabled);
+    //Octahedral normals, PBR maps packed into spare channels and R11G11B10F light, for less bandwidth
+    void SetCompactGBuffer(bool bCompact);
+    //Where the finished frame is composited, 0 for the window. Must be at least the size given to Init
+    //and have a depth buffer, which the debug pass tests against.
+    void SetOutputFramebuffer(GLuint fbo);
 
     //Add to current frame
     void AddStaticMesh(StaticMesh *pMesh, Material *pMat, glm::mat4 matPosition);
+    //The bone transforms are copied, so the caller may reuse them straight away
     void AddAnimatedMesh(AnimatedMesh *pMesh, Material *pMat, glm::mat4 matPosition, const std::vector<glm::mat4> *boneTransforms);
     void AddPointLight(const PointLight& light);
     void AddDirectionalLight(const DirectionalLight& light);
@@ -114,32 +160,288 @@ namespace ne
 
     FrameStats LastFrameStats();
 
+    //Ring the renderer uploads per frame data through, also open to anything drawn after EndFrame
+    StreamBuffer& Stream() { return m_stream; }
+
     //Add to current time value
     void AddTime(double dt);
 
   private:
-    GLuint LoadShader(const std::string &vsPath, const std::string &fsPath, const std::string &gsPath = "");
+    //Layout fixed by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand
+    {
+      GLuint count;
+      GLuint instanceCount;
+      GLuint firstIndex;
+      GLint baseVertex;
+      GLuint baseInstance;
+    };
+
+    //Consecutive draw commands sampling the same texture arrays
+    struct DrawBatch
+    {
+      uint32_t textureSet;
+      size_t firstCommand;
+      size_t numCommands;
+    };
+
+    //Layout of the per instance data in the stream buffer
+    struct InstanceData
+    {
+      glm::mat4 pos;
+      GLuint material; //Into the material table
+      GLuint command; //Draw command the instance belongs to, for occlusion culling
+      GLuint padding[2];
+    };
+
+    //Static mesh draws recorded ahead of submission: the instances in draw order, a command per
+    //run of one mesh and batches of commands sharing a texture set. Holds no GL objects, so any
+    //thread can record one and the GL thread replays it.
+    struct StaticDrawList
+    {
+      std::vector<InstanceData> instances;
+      std::vector<DrawElementsIndirectCommand> commands;
+      std::vector<DrawBatch> batches;
+      int stateChangesSaved; //Texture set binds the batching avoided
+    };
+
+    //The casters drawn into a shadow map in one go, the whole map or a single cube face
+    struct ShadowPass
+    {
+      int face; //Cube face drawn through its own framebuffer, -1 when the pass covers the whole map
+      StaticDrawList staticDraws;
+      std::vector<DrawQueue::Entry> animatedDraws; //Into m_animatedMeshes, in draw order
+    };
+
+    //One light's shadow map, recorded by a job during PrepareFrame and drawn by DrawShadowMaps
+    struct ShadowCommands
+    {
+      size_t block; //Light block of the light
+      bool bCube;
+      GLsizei size; //Of the map in texels
+      glm::mat4 lightTransforms[6]; //View projection of each cube face
+      uint64_t lightKey; //For the shadow cache
+      uint64_t casterHash; //Of the static casters, to check a cached map against
+      std::vector<ShadowPass> passes;
+    };
+
+    //Working space for recording, one per job system thread
+    struct RecordScratch
+    {
+      std::vector<uint32_t> staticCasters; //Indices into m_staticMeshes
+      std::vector<uint32_t> animatedCasters; //Indices into m_animatedMeshes
+      std::vector<uint32_t> staticFaces; //Cube face of each of staticCasters, which repeat per face
+      std::vector<uint32_t> animatedFaces;
+      std::vector<uint32_t> faceCasters; //The casters of one face when each is drawn separately
+      std::vector<uint32_t> faceLayers;
+      DrawQueue queue;
+    };
+
+    //Arrays holding a material's lambert, normal, metallic and roughness maps
+    struct TextureSet
+    {
+      GLuint arrays[4];
+    };
+
+    //std140 layout of the Frame block in frame.glsl
+    struct FrameBlock
+    {
+      glm::mat4 matView;
+      glm::mat4 matInvView;
+      glm::vec3 viewPos;
+      float time;
+      glm::vec2 screenSize;
+      float viewNear;
+      float viewFar;
+      GLint compactGBuffer;
+      GLint padding[3];
+    };
+
+    //std140 layout of the Light block in light.glsl
+    struct LightBlock
+    {
+      glm::mat4 matPos; //Light volume
+      glm::mat4 matLight; //Spot light shadow projection
+      glm::vec3 pos;
+      float radius;
+      glm::vec3 dir;
+      float brightness;
+      glm::vec3 color;
+      float innerAngle; //Cosines
+      float outerAngle;
+      float nearPlane;
+      float farPlane;
+      GLint useShadows;
+      glm::vec4 shadowRect; //The light's tile of the shadow atlas, or corner of each array layer, offset then size in uv
+      GLint shadowLayer; //Point light's first of six layers in the shadow array
+      GLint padding[3];
+    };
+
+    //std140 rounds a block up to a vec4, the bound ranges have to cover all of it
+    static_assert(sizeof(FrameBlock) % 16 == 0, "FrameBlock must match the std140 Frame block");
+    static_assert(sizeof(LightBlock) % 16 == 0, "LightBlock must match the std140 Light block");
+
+    //Where a light's shadow map is drawn, a tile of the atlas or six layers of the array
+    struct ShadowSlot
+    {
+      GLuint fbo;
+      GLuint texture;
+      GLint x;
+      GLint y;
+      GLint layer;
+      GLsizei size; //Of the map, which is square
+    };
+
+    //A spot light waiting for a tile of the shadow atlas
+    struct AtlasRequest
+    {
+      GLsizei size;
+      size_t blockIndex;
+    };
+
+    //Uniform handles of each program, found once after linking. Programs
+    //of a kind share a set and leave the handles they don't use invalid.
+    struct MeshUniforms
+    {
+      Uniform<glm::mat4> matPos;
+      Uniform<GLint> firstBone;
+      Uniform<GLuint> material;
+      Uniform<glm::vec3> color;
+      void Find(const Program& program);
+    };
+
+    struct ShadowUniforms
+    {
+      Uniform<glm::mat4> matLightProj;
+      Uniform<glm::mat4> matLightPos;
+      Uniform<glm::mat4> matPos;
+      Uniform<GLint> firstBone;
+      Uniform<glm::vec3> lightPos;
+      Uniform<float> farPlane;
+      Uniform<GLint> firstLayer;
+      Uniform<GLint> face;
+      void Find(const Program& program);
+    };
+
+    struct ScreenUniforms
+    {
+      Uniform<glm::vec3> lightColor;
+      Uniform<float> gamma;
+      Uniform<float> exposure;
+      Uniform<GLuint> numLights;
+      void Find(const Program& program);
+    };
+
+    struct CullUniforms
+    {
+      Uniform<glm::mat4> matViewProj;
+      Uniform<GLuint> numInstances;
+      Uniform<GLint> phase;
+      Uniform<GLint> hiZLevels;
+      Uniform<GLint> level;
+      void Find(const Program& program);
+    };
+
+    //Occlusion query kept for one heavy animated instance across frames, matched up by the order instances are added
+    struct MeshQuery
+    {
+      const AnimatedMesh* mesh; //The result only stands for the mesh its box was drawn around
+      GLuint query;
+      bool bIssued; //Holds last frame's result for the draw to be conditional on
+    };
+
+    //Where the static queue's occlusion culling reads and writes, two of each written range for the two phases
+    struct OcclusionRanges
+    {
+      GLintptr sourceInstances; //In the stream buffer, every instance of the queue
+      GLintptr spheres;
+      GLintptr commands[2]; //The rest in m_occlusionBuffer
+      GLintptr instances[2];
+      GLintptr rejected;
+    };
+
+    Program LoadShader(const std::string &vsPath, const std::string &fsPath, const std::string &gsPath = "");
+    Program LoadComputeShader(const std::string &csPath);
 
+    bool CreateGBuffer();
     void SetupGeometryPass();
+    void SetupDepthPrePass();
+    void SetupGBufferPass();
     void SetupLightPass();
     void SetupDebugPass();
     void CompositeFrame();
-    void DrawStaticMeshes();
-    void DrawAnimatedMeshes();
+    void DrawStaticMeshes(bool bDepthOnly);
+    void RedrawStaticMeshes();
+    void DrawAnimatedMeshes(bool bDepthOnly);
+    void DrawOcclusionQueries();
+    bool IsQueried(size_t index) const;
+    void DrawStaticList(const StaticDrawList& list, bool bBindMaterials);
+    void BuildStaticDraws(const DrawQueue& queue, bool bBindMaterials, StaticDrawList& list) const;
+    GLuint PushStaticDraws(const StaticDrawList& list, GLintptr& commandsOffset);
+    void IssueStaticDraws(const StaticDrawList& list, GLuint buffer, GLintptr commandsOffset, bool bBindMaterials);
+    void UploadOcclusionData();
+    void CullOccludedMeshes(int phase, const glm::mat4& matViewProj);
+    void DrawCulledStaticMeshes(int phase, bool bDepthOnly);
+    void BuildHiZ();
+    void BindInstanceData(size_t first);
+    void DrawMesh(const StaticMesh* mesh);
     void DrawPointLights();
+    void DrawTiledPointLights();
     void DrawDirectionalLights();
     void DrawSpotLights();
-    void DrawSpotShadowMap(glm::mat4 matView);
-    void DrawPointShadowMap(glm::vec3 position, double nearPlane, double farPlane);
+    void CreateShadowMaps();
+    GLsizei ShadowResolution(glm::vec3 pos, float radius) const;
+    void PackShadowAtlas();
+    void DrawShadowMaps();
+    void DrawSpotShadowMap(const LightBlock& block, const ShadowCommands& commands);
+    void DrawPointShadowMap(const LightBlock& block, const ShadowCommands& commands);
+    void DrawStaticShadowCasters(const ShadowCommands& commands, const ShadowSlot& slot, const ShadowUniforms& uniforms);
+    void DrawShadowCasters(const ShadowCommands& commands, bool bAnimated, const ShadowSlot& slot, const ShadowUniforms& uniforms);
+    void DrawAnimatedShadowQueue(const std::vector<DrawQueue::Entry>& draws, const ShadowUniforms& uniforms);
+    void BindShadowSlot(const ShadowSlot& slot, const ShadowUniforms& uniforms);
     void DrawDebugMesh(const StaticMesh* mesh, const DebugInstance &instance);
+    void DrawLightVolume(const Program& program, const StaticMesh* mesh);
+    void BindTextureSet(uint32_t textureSet);
+    uint32_t MaterialId(const Material* pMat);
+    void UploadMaterials();
+    void UploadFrameConstants();
+    void BuildLightBlocks();
+    void UploadLights();
+    void UploadBonePalette();
+    LightBlock& LightBlockAt(size_t index);
+    const LightBlock& LightBlockAt(size_t index) const;
+    void BindLightBlock(size_t index);
+    uint32_t MeshId(const void* pMesh);
+    template<typename Instance>
+    void QueueDraws(DrawQueue& queue, DrawPass pass, uint32_t program, const std::vector<uint32_t>& indices,
+        const std::vector<Instance>& instances, const CullingBatch& bounds, glm::vec3 eyePos, float farPlane,
+        const std::vector<uint32_t>* pLayers = nullptr) const;
     void UpdateProjectionMatrix();
+    void PrepareFrame();
+    void SubmitFrame();
+    void CullGeometry();
+    void RecordCommands();
+    void RecordViewCommands();
+    void RecordShadowCommands(ShadowCommands& commands, RecordScratch& scratch) const;
+    void RecordShadowPasses(ShadowCommands& commands, bool bAnimated, RecordScratch& scratch, uint32_t program) const;
     void ApplyGlobalIllumination();
 
     bool m_bIsInit;
     bool m_bIsMidFrame;
+    bool m_bTiledLighting; //Compute shaders are available for the tiled light pass
+    bool m_bMultiDraw; //Static queues go out with glMultiDrawElementsIndirect
+    bool m_bShadowCache; //Static shadow casters are drawn into m_shadowCache and reused
+    bool m_bCopyImage; //glCopyImageSubData is available, which the shadow cache relies on
+    bool m_bVertexLayer; //gl_Layer can be set by the vertex shader, so a cube's faces are drawn in one pass
+    bool m_bOcclusionCulling; //Static meshes are tested against a depth pyramid by compute before drawing
+    bool m_bDepthPrePass; //Geometry is drawn depth only first, then into the g buffers where depth is equal
+    bool m_bCompactGBuffer; //m_texNormal and m_texComposite are 32 bits a texel and m_texPBRMaps is unused
+    GLenum m_occlusionQueryTarget; //Conservative where available, it is cheaper and a box is already conservative
+    GLState& m_state; //Every bind and state change goes through here
     int m_width;
     int m_height;
-    int m_shadowMapSize;
+    GLuint m_outputFBO; //Composited into, 0 unless running without a window
+    GLenum m_shadowFormat; //Depth format of every shadow map
     double m_curTime;
     glm::mat4 m_matProjection;
     glm::vec3 m_viewPos;
@@ -147,42 +449,116 @@ namespace ne
     float m_viewTilt;
     float m_gamma;
     float m_exposure;
-    GLuint m_shdStaticMesh;
-    GLuint m_shdAnimatedMesh;
-    GLuint m_shdPointLight;
-    GLuint m_shdDirectionalLight;
-    GLuint m_shdSpotLight;
-    GLuint m_shdGlobalIllum;
-    GLuint m_shdDebug;
-    GLuint m_shdShadows;
-    GLuint m_shdCubeShadows;
-    GLuint m_shdAnimShadows;
-    GLuint m_shdAnimCubeShadows;
-    GLuint m_shdCompositor;
+    Program m_shdStaticMesh;
+    Program m_shdAnimatedMesh;
+    Program m_shdDepth;
+    Program m_shdAnimDepth;
+    Program m_shdPointLight;
+    Program m_shdDirectionalLight;
+    Program m_shdSpotLight;
+    Program m_shdLightStencil;
+    Program m_shdTiledLights;
+    Program m_shdGlobalIllum;
+    Program m_shdDebug;
+    Program m_shdShadows;
+    Program m_shdCubeShadows;
+    Program m_shdAnimShadows;
+    Program m_shdAnimCubeShadows;
+    Program m_shdCompositor;
+    Program m_shdHiZ;
+    Program m_shdOcclusion;
+    MeshUniforms m_uniStaticMesh;
+    MeshUniforms m_uniAnimatedMesh;
+    MeshUniforms m_uniAnimDepth;
+    MeshUniforms m_uniDebug;
+    ScreenUniforms m_uniTiledLights;
+    ShadowUniforms m_uniShadows;
+    ShadowUniforms m_uniAnimShadows;
+    ShadowUniforms m_uniCubeShadows;
+    ShadowUniforms m_uniAnimCubeShadows;
+    ScreenUniforms m_uniGlobalIllum;
+    ScreenUniforms m_uniCompositor;
+    CullUniforms m_uniHiZ;
+    CullUniforms m_uniOcclusion;
     GLuint m_texLambert;
     GLuint m_texNormal;
     GLuint m_texPBRMaps;
     GLuint m_texDepth;
     GLuint m_texComposite;
+    GLuint m_texCompositeDepth; //Copy of m_texDepth with a stencil for marking light volumes
     GLuint m_FBO;
     GLuint m_shadowFBO;
-    GLuint m_shadowCubeFBO;
+    GLuint m_shadowCubeFBO; //Layered, so one clear empties every layer
+    GLuint m_shadowFaceFBO; //Attached to one cube face at a time when gl_Layer can't be set
     GLuint m_compositeFBO;
-    GLuint m_texShadow;
-    GLuint m_texShadowCube;
-    GLuint m_qryTimers[10]; //5 * 2 (double-buffered)
-    GLuint m_qryShadows[2];
-    double m_shadowTime;
+    GLuint m_texShadowAtlas; //Spot light shadow maps, one tile each
+    GLuint m_texShadowCubes; //Point light shadow maps, six layers each in cube face order
+    int m_numSpotShadows; //Tiles of m_texShadowAtlas handed out this frame
+    int m_numPointShadows; //Cubes of m_texShadowCubes handed out this frame
+    std::vector<AtlasRequest> m_atlasRequests; //Spot lights' tiles of m_texShadowAtlas, packed together
+    ShadowCache m_shadowCache;
+    GLuint m_texHiZ; //Farthest depth of the geometry pass, each level halving the last
+    GLsizei m_hiZWidth; //Of level 0, the screen rounded down to powers of two
+    GLsizei m_hiZHeight;
+    GLint m_hiZMips;
+    bool m_bHiZDrawn; //Whether m_texHiZ holds an earlier frame's depth yet
+    glm::mat4 m_matHiZ; //View projection m_texHiZ was drawn with
+    GLuint m_occlusionBuffer; //Culled draw commands and instances, only ever touched by the GPU
+    size_t m_occlusionBufferSize;
+    OcclusionRanges m_occlusionRanges;
+    GLuint m_texBonePalette; //m_bonePalette, read by the skinning shaders
+    GLsizei m_bonePaletteRows; //Height of m_texBonePalette
+    StreamBuffer m_stream; //Per frame uniform blocks, instance data, draw commands and tiled lights
+    size_t m_uniformAlignment; //Offset alignment for uniform buffer ranges
+    size_t m_storageAlignment; //Offset alignment for shader storage ranges
+    size_t m_lightBlockStride; //sizeof(LightBlock) rounded up to the uniform buffer offset alignment
+    std::vector<char> m_lightBlocks; //Point, then spot, then directional lights' LightBlocks
+    GLuint m_lightBlocksBuffer; //The stream buffer m_lightBlocks went into, later pushes may grow it into another
+    GLintptr m_lightBlocksOffset; //Where m_lightBlocks went in the stream buffer
+    GLintptr m_instanceOffset; //Where the static mesh queue being drawn put its instance data
+    GLintptr m_staticCommandsOffset; //Where m_staticQueue's draw commands went, for the g buffer pass to repeat
+    GLuint m_staticDrawsBuffer; //The stream buffer they and their instances went into
+    GpuTimers m_timers; //Per pass and per light GPU times, read back without waiting
     StaticMesh* m_pPlane;
     StaticMesh* m_pCube;
     StaticMesh* m_pSphere;
+    StaticMesh* m_pCone;
     Texture *m_pDefaultLambert;
     Texture *m_pDefaultNormal;
     Texture *m_pDefaultMetallic;
     Texture *m_pDefaultRoughness;
     std::vector<StaticMeshInstance> m_staticMeshes;
     std::vector<AnimatedMeshInstance> m_animatedMeshes;
+    std::vector<glm::vec4> m_bonePalette; //Top three rows of each bone transform for m_animatedMeshes
+    CullingBatch m_staticBounds; //World space bounds of m_staticMeshes
+    CullingBatch m_animatedBounds; //World space bounds of m_animatedMeshes
+    std::vector<uint32_t> m_visibleStaticMeshes; //Indices into m_staticMeshes
+    std::vector<uint32_t> m_visibleAnimatedMeshes; //Indices into m_animatedMeshes
+    std::vector<MeshQuery> m_meshQueries; //Indexed like m_animatedMeshes, each query generated on first use and reused after
+    DrawQueue m_staticQueue; //m_visibleStaticMeshes in draw order
+    DrawQueue m_animatedQueue; //m_visibleAnimatedMeshes in draw order
+    StaticDrawList m_viewDraws; //m_staticQueue recorded for the depth pre-pass and g buffer pass
+    std::vector<ShadowCommands> m_shadowCommands; //Every shadowed light, point lights first as in the light blocks
+    JobSystem m_jobs; //Records the view and each shadow map in parallel
+    std::vector<RecordScratch> m_recordScratch; //One per m_jobs thread
+    std::unordered_map<const Material*, uint32_t> m_materialIds; //Per frame index into the material table
+    std::vector<glm::ivec4> m_materialLayers; //Material table, the layer of each map within its texture set
+    std::vector<uint32_t> m_materialTextureSets; //Index into m_textureSets for each material
+    std::vector<TextureSet> m_textureSets; //Distinct texture arrays bound this frame
+    std::unordered_map<const void*, uint32_t> m_meshIds; //Small per frame ids for sort keys
+    std::vector<glm::vec4> m_instanceSpheres; //Bounding sphere of each of m_viewDraws' instances, staging for occlusion culling
+    int m_meshesDrawn;
+    int m_meshesCulled;
+    int m_meshesQueried;
+    int m_shadowCastersDrawn;
+    int m_shadowMapsCached;
+    int m_shadowTexels;
+    int m_tiledLightsDrawn;
+    int m_stateChangesSaved;
+    int m_drawCalls;
+    int m_stateFiltered;
     std::vector<PointLight> m_pointLights;
+    std::vector<glm::vec4> m_tiledLightData; //Position and radius, then color and brightness, per light
     std::vector<DirectionalLight> m_directionalLights;
     std::vector<SpotLight> m_spotLights;
     std::vector<DebugInstance> m_debugCubes;
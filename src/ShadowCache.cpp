@@ -0,0 +1,135 @@
+#include "ShadowCache.hpp"
+#include "GLState.hpp"
+
+namespace ne
+{
+
+  ShadowCache::ShadowCache() :
+    m_format(GL_DEPTH_COMPONENT24),
+    m_maxSpotMaps(0),
+    m_maxPointMaps(0),
+    m_frame(1)
+  {
+  }
+
+  ShadowCache::~ShadowCache()
+  {
+    Clear();
+  }
+
+  void ShadowCache::Init(GLenum format, size_t maxSpotMaps, size_t maxPointMaps)
+  {
+    Clear();
+    m_format = format;
+    m_maxSpotMaps = maxSpotMaps;
+    m_maxPointMaps = maxPointMaps;
+  }
+
+  void ShadowCache::NextFrame()
+  {
+    ++m_frame;
+  }
+
+  ShadowCache::Entry* ShadowCache::Find(uint64_t lightKey, bool bCube, GLsizei size)
+  {
+    if(bCube)
+      return Find(m_pointMaps, m_maxPointMaps, lightKey, bCube, size);
+    return Find(m_spotMaps, m_maxSpotMaps, lightKey, bCube, size);
+  }
+
+  ShadowCache::Entry* ShadowCache::Find(std::vector<Entry>& entries, size_t maxEntries, uint64_t lightKey, bool bCube, GLsizei size)
+  {
+    Entry* pOldest = nullptr;
+    for(Entry& entry : entries)
+    {
+      //Two lights with the same projection see the same static casters, so they may share
+      if(entry.bValid && entry.lightKey == lightKey)
+      {
+        //A light whose resolution changed starts again at the new size
+        if(entry.size != size)
+        {
+          Allocate(entry, bCube, size);
+          entry.bValid = false;
+        }
+        entry.lastUsed = m_frame;
+        return &entry;
+      }
+
+      if(entry.lastUsed != m_frame && (!pOldest || entry.lastUsed < pOldest->lastUsed))
+        pOldest = &entry;
+    }
+
+    if(entries.size() < maxEntries)
+    {
+      entries.push_back(Entry{0, 0, false, 0, 0, 0, 0});
+      pOldest = &entries.back();
+    }
+
+    if(!pOldest)
+      return nullptr;
+
+    if(pOldest->size != size)
+      Allocate(*pOldest, bCube, size);
+    pOldest->lightKey = lightKey;
+    pOldest->bValid = false;
+    pOldest->lastUsed = m_frame;
+    return pOldest;
+  }
+
+  void ShadowCache::Allocate(Entry& entry, bool bCube, GLsizei size) const
+  {
+    GLState& state = GLState::Current();
+    const GLenum target = bCube ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+
+    //Storage is immutable, so a new size needs a new texture
+    if(entry.texture)
+      state.DeleteTextures(1, &entry.texture);
+    if(!entry.fbo)
+      glGenFramebuffers(1, &entry.fbo);
+
+    //Only ever drawn into and copied from, never sampled
+    glGenTextures(1, &entry.texture);
+    state.BindTexture(0, target, entry.texture);
+    if(bCube)
+      glTexStorage3D(target, 1, m_format, size, size, 6);
+    else
+      glTexStorage2D(target, 1, m_format, size, size);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    state.BindFramebuffer(GL_FRAMEBUFFER, entry.fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, entry.texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    entry.size = size;
+  }
+
+  void ShadowCache::Clear()
+  {
+    for(std::vector<Entry>* pEntries : {&m_spotMaps, &m_pointMaps})
+    {
+      for(const Entry& entry : *pEntries)
+      {
+        GLState::Current().DeleteFramebuffers(1, &entry.fbo);
+        GLState::Current().DeleteTextures(1, &entry.texture);
+      }
+      pEntries->clear();
+    }
+  }
+
+  uint64_t ShadowCache::Hash(const void* data, size_t size, uint64_t seed)
+  {
+    //FNV-1a
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for(size_t i = 0; i < size; ++i)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace ne
+{
+  //Shadow maps holding only static casters, kept across frames for lights
+  //that have not moved. Lights are recognised by a hash of their shadow
+  //projection, and a map is redrawn when the hash of its casters changes.
+  //Maps are copied into the light's slot of the shadow atlas or array, and
+  //are sized to the resolution the light was last given.
+  class ShadowCache
+  {
+  public:
+    struct Entry
+    {
+      uint64_t lightKey;
+      uint64_t casterHash; //Of the static casters last drawn into it
+      bool bValid; //Holds the casters of casterHash
+      GLuint texture; //Depth, 2D for spot lights and six layers in cube face order for point lights
+      GLuint fbo;
+      GLsizei size; //Width and height of each layer
+      size_t lastUsed; //Frame it was last handed out
+    };
+
+    ShadowCache();
+    ~ShadowCache();
+
+    //Drops every map, they are recreated in format as lights need them
+    void Init(GLenum format, size_t maxSpotMaps, size_t maxPointMaps);
+    void NextFrame();
+
+    //The light's map, or the least recently used one of its kind emptied for
+    //it. Null once every map of the kind has been handed out this frame.
+    Entry* Find(uint64_t lightKey, bool bCube, GLsizei size);
+
+    static uint64_t Hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+  private:
+    ShadowCache(const ShadowCache&) = delete;
+    ShadowCache& operator=(const ShadowCache&) = delete;
+
+    Entry* Find(std::vector<Entry>& entries, size_t maxEntries, uint64_t lightKey, bool bCube, GLsizei size);
+    void Allocate(Entry& entry, bool bCube, GLsizei size) const;
+    void Clear();
+
+    GLenum m_format;
+    size_t m_maxSpotMaps;
+    size_t m_maxPointMaps;
+    size_t m_frame;
+    std::vector<Entry> m_spotMaps; //Created as lights need them, up to m_maxSpotMaps
+    std::vector<Entry> m_pointMaps; //Created as lights need them, up to m_maxPointMaps
+  };
+}
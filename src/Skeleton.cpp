@@ -1,10 +1,13 @@
 #include "Skeleton.hpp"
 
+#include "Profiler.hpp"
+
 namespace ne
 {
 
   void Skeleton::calculateTransforms(std::vector<glm::mat4>& outTrans) const
   {
+    NE_PROFILE_ZONE("Skeleton::calculateTransforms");
     //Calculate local transformation matrix for each bone first
     for(size_t i = 0; i < bones.size(); ++i)
       outTrans[i] = glm::translate(bones[i].localPos) * glm::mat4_cast(bones[i].localRot);
@@ -2,6 +2,7 @@
 
 #include <glm/vec3.hpp>
 #include "OpenGL.hpp"
+#include "Bounds.hpp"
 #include <stdint.h>
 
 namespace ne
@@ -16,14 +17,11 @@ namespace ne
 
   private:
     StaticMesh();
-    GLuint m_vaoConfig; //Configuration vao
-    GLuint m_vboVertices; //VBO containing vertices
-    GLuint m_vboIndices; //VBO containing indices
+    GLuint m_vaoConfig; //The GeometryArena's vao, shared with every other static mesh
     int m_iNumTris; //Number of triangles total
-    int m_iNumIndices; //Number of indices in the buffer
-    int m_iStride; //Number of bytes until next value of same type
-    uintptr_t m_iOffPos; //The offset to position data (-1 if not given)
-    uintptr_t m_iOffUV; //The offset to UV data (-1 if not given)
-    uintptr_t m_iOffNormal; //The offset to normal data (-1 if not given)
+    int m_iNumIndices; //Number of indices in the arena
+    GLint m_iBaseVertex; //First vertex in the arena
+    GLuint m_iFirstIndex; //First index in the arena
+    Bounds m_bounds; //Local space bounds of the vertices
   };
 }
@@ -0,0 +1,184 @@
+#include "StreamBuffer.hpp"
+
+#include <iostream>
+#include <string.h>
+
+namespace
+{
+  //How long to block on a fence before asking again, in nanoseconds
+  const GLuint64 FENCE_WAIT_TIMEOUT = 1000000000;
+
+  size_t AlignUp(size_t offset, size_t alignment)
+  {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+}
+
+namespace ne
+{
+
+  StreamBuffer::StreamBuffer() :
+    m_bPersistent(false),
+    m_buffer(0),
+    m_pMapped(nullptr),
+    m_frameSize(0),
+    m_head(0),
+    m_region(0),
+    m_fences()
+  {
+  }
+
+  StreamBuffer::~StreamBuffer()
+  {
+    for(GLsync fence : m_fences)
+      if(fence)
+        glDeleteSync(fence);
+    for(const Retired& retired : m_retired)
+    {
+      glDeleteSync(retired.fence);
+      glDeleteBuffers(1, &retired.buffer);
+    }
+    //Deleting a mapped buffer unmaps it
+    if(m_buffer)
+      glDeleteBuffers(1, &m_buffer);
+  }
+
+  bool StreamBuffer::Init(size_t frameSize, bool bPersistent)
+  {
+    m_bPersistent = bPersistent;
+    Create(frameSize);
+
+    if(m_bPersistent && !m_pMapped)
+    {
+      std::cerr << "Could not map stream buffer, falling back to orphaning" << std::endl;
+      glDeleteBuffers(1, &m_buffer);
+      m_bPersistent = false;
+      Create(frameSize);
+    }
+    return m_buffer != 0;
+  }
+
+  void StreamBuffer::BeginFrame()
+  {
+    //Buffers outgrown in earlier frames can go once the GPU has caught up
+    for(size_t i = 0; i < m_retired.size();)
+    {
+      const GLenum status = glClientWaitSync(m_retired[i].fence, 0, 0);
+      if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      {
+        ++i;
+        continue;
+      }
+      glDeleteSync(m_retired[i].fence);
+      glDeleteBuffers(1, &m_retired[i].buffer);
+      m_retired[i] = m_retired.back();
+      m_retired.pop_back();
+    }
+
+    if(!m_bPersistent)
+    {
+      //The driver hands back fresh storage and frees the old once the GPU is done with it
+      glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+      glBufferData(GL_COPY_WRITE_BUFFER, m_frameSize, NULL, GL_STREAM_DRAW);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      m_head = 0;
+      return;
+    }
+
+    if(m_fences[m_region])
+      glDeleteSync(m_fences[m_region]);
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_region = (m_region + 1) % FRAMES_IN_FLIGHT;
+    Wait(m_fences[m_region]);
+    m_head = m_region * m_frameSize;
+  }
+
+  GLintptr StreamBuffer::Allocate(size_t size, size_t alignment)
+  {
+    const size_t regionEnd = (m_bPersistent ? m_region + 1 : 1) * m_frameSize;
+    size_t offset = AlignUp(m_head, alignment);
+    if(offset + size > regionEnd)
+    {
+      Grow(size + alignment);
+      offset = AlignUp(m_head, alignment);
+    }
+
+    m_head = offset + size;
+    return offset;
+  }
+
+  void StreamBuffer::Write(GLintptr offset, const void* data, size_t size)
+  {
+    if(m_pMapped)
+    {
+      //Coherent, so the GPU sees this without a flush
+      memcpy(m_pMapped + offset, data, size);
+      return;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  GLintptr StreamBuffer::Push(const void* data, size_t size, size_t alignment)
+  {
+    const GLintptr offset = Allocate(size, alignment);
+    Write(offset, data, size);
+    return offset;
+  }
+
+  void StreamBuffer::Create(size_t frameSize)
+  {
+    m_frameSize = frameSize;
+    m_region = 0;
+    m_head = 0;
+    m_pMapped = nullptr;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    if(m_bPersistent)
+    {
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_COPY_WRITE_BUFFER, m_frameSize * FRAMES_IN_FLIGHT, NULL, flags);
+      m_pMapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_frameSize * FRAMES_IN_FLIGHT, flags);
+    }
+    else
+    {
+      glBufferData(GL_COPY_WRITE_BUFFER, m_frameSize, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  void StreamBuffer::Grow(size_t needed)
+  {
+    //Ranges handed out this frame stay bound to the old buffer, so it is
+    //only deleted in a later frame once the GPU is done with it
+    m_retired.push_back(Retired{m_buffer, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+    for(GLsync& fence : m_fences)
+    {
+      if(fence)
+        glDeleteSync(fence);
+      fence = nullptr;
+    }
+
+    size_t frameSize = m_frameSize * 2;
+    while(frameSize < needed)
+      frameSize *= 2;
+    Create(frameSize);
+  }
+
+  void StreamBuffer::Wait(GLsync fence)
+  {
+    if(!fence)
+      return;
+
+    GLenum status;
+    do
+    {
+      status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT);
+    } while(status == GL_TIMEOUT_EXPIRED);
+  }
+
+}
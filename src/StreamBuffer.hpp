@@ -0,0 +1,58 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include <stddef.h>
+#include <vector>
+
+namespace ne
+{
+  //One buffer that a frame's dynamic data is written into and drawn from by
+  //offset. It is split into a region per frame in flight, each fenced once the
+  //frame is submitted so writes never wait on the driver. With GL 4.4 the
+  //buffer stays mapped, without it each frame orphans the whole buffer.
+  class StreamBuffer
+  {
+  public:
+    StreamBuffer();
+    ~StreamBuffer();
+
+    bool Init(size_t frameSize, bool bPersistent);
+
+    //Fence the region just written and move on to the next, waiting for the
+    //GPU if it is still reading from it
+    void BeginFrame();
+
+    //Reserve space in this frame's region. The offset is from the start of
+    //Buffer(), which only changes when a frame outgrows its region.
+    GLintptr Allocate(size_t size, size_t alignment);
+    void Write(GLintptr offset, const void* data, size_t size);
+    GLintptr Push(const void* data, size_t size, size_t alignment);
+
+    GLuint Buffer() const { return m_buffer; }
+
+    static const int FRAMES_IN_FLIGHT = 3;
+
+  private:
+    struct Retired
+    {
+      GLuint buffer;
+      GLsync fence;
+    };
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    void Create(size_t frameSize);
+    void Grow(size_t needed);
+    void Wait(GLsync fence);
+
+    bool m_bPersistent;
+    GLuint m_buffer;
+    char* m_pMapped; //Persistent mapping of the whole buffer
+    size_t m_frameSize; //In bytes, one region
+    size_t m_head; //Next free byte, from the start of the buffer
+    int m_region; //Region being written this frame
+    GLsync m_fences[FRAMES_IN_FLIGHT]; //Signalled once the GPU is done with each region
+    std::vector<Retired> m_retired; //Outgrown buffers still in use by the GPU
+  };
+}
@@ -1,13 +1,14 @@
 #include "Texture.hpp"
+#include "TextureArrays.hpp"
 
 namespace ne
 {
-  Texture::Texture() : m_glTexture(0), m_width(0), m_height(0) {};
+  Texture::Texture() : m_glTexture(0), m_layer(0), m_width(0), m_height(0) {};
 
   Texture::~Texture()
   {
     if(m_glTexture)
-      glDeleteTextures(1, &m_glTexture);
+      TextureArrays::Static().Release(m_glTexture);
   }
 
   int Texture::Width()
@@ -14,7 +14,8 @@ namespace ne
     int Height();
   private:
     Texture();
-    GLuint m_glTexture;
+    GLuint m_glTexture; //The GL_TEXTURE_2D_ARRAY holding this texture
+    GLint m_layer;
     int m_width;
     int m_height;
   };
@@ -0,0 +1,123 @@
+#include "TextureArrays.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ne
+{
+
+  TextureArrays& TextureArrays::Static()
+  {
+    static TextureArrays arrays;
+    return arrays;
+  }
+
+  void TextureArrays::Allocate(GLsizei width, GLsizei height, GLenum internalFormat, bool bMipmaps, const void* pixels,
+      GLuint& outArray, GLint& outLayer)
+  {
+    Bucket* pBucket = nullptr;
+    for(Bucket& bucket : m_buckets)
+    {
+      if(bucket.width == width && bucket.height == height && bucket.internalFormat == internalFormat &&
+          bucket.bMipmaps == bMipmaps && bucket.numLayers < LAYERS_PER_ARRAY)
+      {
+        pBucket = &bucket;
+        break;
+      }
+    }
+
+    //Full buckets are left alone and a new array is started beside them
+    if(!pBucket)
+    {
+      const GLsizei levels = bMipmaps ? GLsizei(std::log2(std::max(width, height))) + 1 : 1;
+
+      Bucket bucket = {0, width, height, internalFormat, bMipmaps, levels, 0, 0, 0, false};
+      glGenTextures(1, &bucket.array);
+      GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, bucket.array);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, bMipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, bMipmaps ? GL_LINEAR : GL_NEAREST);
+
+      m_buckets.push_back(bucket);
+      pBucket = &m_buckets.back();
+    }
+
+    if(pBucket->numLayers == pBucket->capacity)
+      Grow(*pBucket);
+
+    GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, pBucket->array);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, pBucket->numLayers, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+    pBucket->bStaleMips = pBucket->bMipmaps;
+
+    outArray = pBucket->array;
+    outLayer = pBucket->numLayers;
+    ++pBucket->numLayers;
+    ++pBucket->numLive;
+  }
+
+  void TextureArrays::Grow(Bucket& bucket)
+  {
+    //Storage is mutable so the array keeps its name, and with it every texture already handed out.
+    //What is there is read back and put into the bigger storage, which happens a few times per array.
+    const GLint capacity = bucket.capacity == 0 ? 1 : bucket.capacity * 2 < LAYERS_PER_ARRAY ? bucket.capacity * 2 : LAYERS_PER_ARRAY;
+    const GLsizei keptLevels = bucket.bStaleMips ? 1 : bucket.levels;
+
+    GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, bucket.array);
+    std::vector<unsigned char> pixels;
+    for(GLsizei level = 0; level < bucket.levels; ++level)
+    {
+      const GLsizei width = std::max(bucket.width >> level, 1);
+      const GLsizei height = std::max(bucket.height >> level, 1);
+
+      //Rows are padded to the default pack and unpack alignment of 4
+      const bool bKeep = bucket.numLayers > 0 && level < keptLevels;
+      if(bKeep)
+      {
+        pixels.resize(size_t((width * 3 + 3) & ~3) * height * bucket.numLayers);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+      }
+
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, bucket.internalFormat, width, height, capacity, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+      if(bKeep)
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, bucket.numLayers, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    }
+    GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+    bucket.capacity = capacity;
+  }
+
+  void TextureArrays::UpdateMipmaps()
+  {
+    for(Bucket& bucket : m_buckets)
+    {
+      if(!bucket.bStaleMips)
+        continue;
+
+      GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, bucket.array);
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+      bucket.bStaleMips = false;
+    }
+    GLState::Current().BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+  }
+
+  void TextureArrays::Release(GLuint array)
+  {
+    for(auto it = m_buckets.begin(); it != m_buckets.end(); ++it)
+    {
+      if(it->array != array)
+        continue;
+
+      if(--it->numLive == 0)
+      {
+        GLState::Current().DeleteTextures(1, &it->array);
+        m_buckets.erase(it);
+      }
+      return;
+    }
+  }
+
+}
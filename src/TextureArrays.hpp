@@ -0,0 +1,47 @@
+#pragma once
+
+#include "OpenGL.hpp"
+#include <vector>
+
+namespace ne
+{
+  //Textures packed into GL_TEXTURE_2D_ARRAY buckets by size and format, so
+  //materials whose maps share buckets can be drawn without rebinding and
+  //pick their layers out of the material table instead.
+  class TextureArrays
+  {
+  public:
+    static TextureArrays& Static(); //The arrays holding every Texture
+
+    //Copy an RGB8 image into a free layer of a matching array, its mips wait for UpdateMipmaps
+    void Allocate(GLsizei width, GLsizei height, GLenum internalFormat, bool bMipmaps, const void* pixels,
+        GLuint& outArray, GLint& outLayer);
+    //Layers are not reused, an array is freed once all of its textures have been released
+    void Release(GLuint array);
+    //Builds the mips of every array given layers since the last call, once however many arrived
+    void UpdateMipmaps();
+
+    static const GLint LAYERS_PER_ARRAY = 16; //Arrays start with one layer and double up to this
+
+  private:
+    struct Bucket
+    {
+      GLuint array;
+      GLsizei width;
+      GLsizei height;
+      GLenum internalFormat;
+      bool bMipmaps;
+      GLsizei levels;
+      GLint capacity; //Layers the array has storage for
+      GLint numLayers; //Layers handed out so far
+      GLint numLive; //Layers not yet released
+      bool bStaleMips; //Layers were added since the mips were last built
+    };
+
+    TextureArrays() {}
+
+    void Grow(Bucket& bucket);
+
+    std::vector<Bucket> m_buckets;
+  };
+}
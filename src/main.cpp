@@ -3,7 +3,10 @@
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 #include "OpenGL.hpp"
@@ -17,6 +20,7 @@
 #include "Texture.hpp"
 #include "Material.hpp"
 #include "ImguiWrapper.hpp"
+#include "Profiler.hpp"
 
 void APIENTRY glDebugOutput(GLenum source,
                             GLenum type,
@@ -69,18 +73,80 @@ void APIENTRY glDebugOutput(GLenum source,
   std::cout << std::endl;
 }
 
+//Each thread's zones of one frame as rows of bars, nested zones beneath their parents
+void DrawFlameView(const std::vector<ne::CpuZone>& zones, uint64_t frameStart, uint64_t frameEnd)
+{
+  const float width = 600.0f;
+  const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+
+  //Threads are stacked, each as deep as its deepest zone
+  std::vector<int> threadDepths;
+  for(const ne::CpuZone& zone : zones)
+  {
+    if((size_t)zone.thread >= threadDepths.size())
+      threadDepths.resize(zone.thread + 1, -1);
+    threadDepths[zone.thread] = std::max(threadDepths[zone.thread], zone.depth);
+  }
+
+  std::vector<int> threadRows(threadDepths.size());
+  int numRows = 0;
+  for(size_t i = 0; i < threadDepths.size(); ++i)
+  {
+    threadRows[i] = numRows;
+    numRows += threadDepths[i] + 1;
+  }
+
+  ImGui::Text("CPU Frame: %.3fms", double(frameEnd - frameStart) / 1e6);
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImGui::Dummy(ImVec2(width, std::max(numRows, 1) * rowHeight));
+
+  if(frameEnd <= frameStart)
+    return;
+
+  ImDrawList* drawList = ImGui::GetWindowDrawList();
+  const double scale = width / double(frameEnd - frameStart);
+  for(const ne::CpuZone& zone : zones)
+  {
+    const float x0 = origin.x + float(double(zone.start - frameStart) * scale);
+    const float x1 = std::max(x0 + 1.0f, origin.x + std::min(width, float(double(zone.end - frameStart) * scale)));
+    const float y0 = origin.y + (threadRows[zone.thread] + zone.depth) * rowHeight;
+    const ImVec2 min(x0, y0);
+    const ImVec2 max(x1, y0 + rowHeight - 1.0f);
+
+    //Colour by name so a zone keeps its colour from frame to frame
+    unsigned hash = 2166136261u;
+    for(const char* c = zone.name; *c; ++c)
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+    drawList->AddRectFilled(min, max, ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.6f));
+    drawList->PushClipRect(min, max, true);
+    drawList->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_WHITE, zone.name);
+    drawList->PopClipRect();
+
+    if(ImGui::IsMouseHoveringRect(min, max))
+      ImGui::SetTooltip("%s: %.3fms", zone.name, double(zone.end - zone.start) / 1e6);
+  }
+}
+
 struct Light
 {
   bool enabled;
   glm::vec3 pos;
   glm::vec3 color;
   float bright;
+  bool shadows;
 };
 
 int main(int argc, char **argv)
 {
-  (void)argc;
-  (void)argv;
+  //--trace N writes a trace once N frames have been drawn, F12 writes one at any time
+  const char* tracePath = "trace.json";
+  int traceFrames = -1;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      traceFrames = atoi(argv[++i]);
+  }
 
   if(SDL_Init(SDL_INIT_VIDEO) < 0)
   {
@@ -137,12 +203,15 @@ int main(int argc, char **argv)
   double lightTime = 0.0;
 
   std::vector<Light> lights;
-  lights.push_back(Light{true, glm::vec3(-5,3,0), glm::vec3(1), 5.0f});
-  lights.push_back(Light{true, glm::vec3( 5,3,0), glm::vec3(1), 5.0f});
+  lights.push_back(Light{true, glm::vec3(-5,3,0), glm::vec3(1), 5.0f, true});
+  lights.push_back(Light{true, glm::vec3( 5,3,0), glm::vec3(1), 5.0f, true});
 
+  int frameCount = 0;
   bool quit = false;
   while(!quit)
   {
+    ne::Profiler::Instance().NextFrame();
+
     double curTime = SDL_GetTicks() / 1000.0;
     double dt = curTime - lastTime;
     lastTime = curTime;
@@ -178,8 +247,8 @@ int main(int argc, char **argv)
       static float speed = 1.0;
       runAnim->apply(cowboySkel, timePoint);
 
-      static std::vector<glm::mat4> boneTransforms(32, glm::mat4(1.0));
-      static std::vector<glm::mat4> boneInvTransforms(32, glm::mat4(1.0));
+      static std::vector<glm::mat4> boneTransforms(cowboySkel->bones.size(), glm::mat4(1.0));
+      static std::vector<glm::mat4> boneInvTransforms(cowboySkel->bones.size(), glm::mat4(1.0));
       cowboySkel->calculateTransforms(boneTransforms);
       cowboySkel->calculateInvTransforms(boneInvTransforms);
 
@@ -211,6 +280,12 @@ int main(int argc, char **argv)
     static float globalIllum = 0.025;
     static float gamma = 2.2;
     static float exposure = 0.0;
+    static bool shadows16 = false;
+    static bool depthPrePass = false;
+    static bool compactGBuffer = false;
+    static bool occlusionCulling = true;
+    static bool tiledLighting = true;
+    static bool shadowCache = true;
 
     static bool cameraLight = false;
     static glm::vec3 cameraLightCol(1.0);
@@ -298,12 +373,50 @@ int main(int argc, char **argv)
     {
       ne::FrameStats fs = pRenderer->LastFrameStats();
       ImGui::Begin("Profiler", &profiler, ImGuiWindowFlags_AlwaysAutoResize);
+      ImGui::Checkbox("Depth Pre-Pass", &depthPrePass);
+      ImGui::Checkbox("Compact G-Buffer", &compactGBuffer);
+      ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+      ImGui::Checkbox("Tiled Lighting", &tiledLighting);
+      ImGui::Checkbox("Shadow Cache", &shadowCache);
+      ImGui::Separator();
       ImGui::LabelText("Total Time", "%f", fs.totalTime);
+      ImGui::LabelText("Depth Pre-Pass Time", "%f", fs.depthPrePassTime);
       ImGui::LabelText("Geometry Time", "%f", fs.geometryTime);
       ImGui::LabelText("Lighting Time", "%f", fs.lightingTime);
       ImGui::LabelText("Shadow Time", "%f", fs.shadowTime);
       ImGui::LabelText("Composite Time", "%f", fs.compositeTime);
       ImGui::LabelText("Debug Time", "%f", fs.debugTime);
+      ImGui::Separator();
+      ImGui::LabelText("Meshes Drawn", "%d", fs.meshesDrawn);
+      ImGui::LabelText("Meshes Culled", "%d", fs.meshesCulled);
+      ImGui::LabelText("Meshes Queried", "%d", fs.meshesQueried);
+      ImGui::LabelText("Shadow Casters Drawn", "%d", fs.shadowCastersDrawn);
+      ImGui::LabelText("Shadow Maps Cached", "%d", fs.shadowMapsCached);
+      ImGui::LabelText("Shadow Texels", "%d", fs.shadowTexels);
+      ImGui::LabelText("Tiled Lights", "%d", fs.tiledLights);
+      ImGui::LabelText("State Changes Saved", "%d", fs.stateChangesSaved);
+      ImGui::LabelText("Draw Calls", "%d", fs.drawCalls);
+      ImGui::LabelText("State Calls Filtered", "%d", fs.stateFiltered);
+      ImGui::Separator();
+      {
+        std::vector<ne::CpuZone> zones;
+        uint64_t frameStart, frameEnd;
+        ne::Profiler::Instance().LastFrame(zones, frameStart, frameEnd);
+        DrawFlameView(zones, frameStart, frameEnd);
+      }
+      ImGui::Button("Write Trace");
+      if(ImGui::IsItemClicked())
+        ne::Profiler::Instance().WriteChromeTrace(tracePath);
+      if(ImGui::CollapsingHeader("GPU Scopes"))
+      {
+        for(const ne::GpuScope& scope : fs.gpuScopes)
+        {
+          if(scope.index >= 0)
+            ImGui::Text("%*s%s %d: %f", scope.depth * 2, "", scope.name, scope.index, scope.time);
+          else
+            ImGui::Text("%*s%s: %f", scope.depth * 2, "", scope.name, scope.time);
+        }
+      }
       ImGui::End();
     }
 
@@ -330,6 +443,7 @@ int main(int argc, char **argv)
       ImGui::SliderFloat("Global Illumination", &globalIllum, 0.0, 0.02);
       ImGui::SliderFloat("Gamma", &gamma, 1.0, 3.0);
       ImGui::SliderFloat("Exposure", &exposure, 0.0, 10.0);
+      ImGui::Checkbox("16-bit Shadows", &shadows16);
       ImGui::Separator();
       ImGui::Checkbox("Sun", &sun);
       ImGui::SliderFloat("Sun Strength", &sunStrength, 0.0, 1.0);
@@ -339,7 +453,7 @@ int main(int argc, char **argv)
       ImGui::Button("Add Light");
       if(ImGui::IsItemClicked())
       {
-        lights.push_back(Light{true, glm::vec3{0, 2, 0}, glm::vec3{1}, 1.0});
+        lights.push_back(Light{true, glm::vec3{0, 2, 0}, glm::vec3{1}, 1.0, true});
       }
 
       for(size_t i = 0; i < lights.size(); ++i)
@@ -351,6 +465,7 @@ int main(int argc, char **argv)
         ImGui::DragFloat3("Position", &light.pos.x, 0.01);
         ImGui::ColorEdit3("Color", &light.color.x);
         ImGui::DragFloat("Brightness", &light.bright, 0.01);
+        ImGui::Checkbox("Shadows", &light.shadows);
         ImGui::Button("Delete");
         if(ImGui::IsItemClicked())
           lights.erase(lights.begin() + i);
@@ -405,7 +520,7 @@ int main(int argc, char **argv)
     {
       if(light.enabled)
       {
-        pRenderer->AddPointLight(ne::PointLight(light.pos, light.color, light.bright));
+        pRenderer->AddPointLight(ne::PointLight(light.pos, light.color, light.bright, 0.0f, light.shadows));
         glm::mat4 scale = glm::scale(glm::mat4(1.0), glm::vec3(0.2));
         glm::mat4 tran = glm::translate(glm::mat4(1.0), light.pos);
         pRenderer->AddDebugSphere(tran * scale, glm::vec3(1.0));
@@ -415,13 +530,22 @@ int main(int argc, char **argv)
     pRenderer->SetGlobalIllumination(glm::vec3(globalIllum));
     pRenderer->SetGamma(gamma);
     pRenderer->SetExposure(exposure);
+    pRenderer->SetShadowDepthBits(shadows16 ? 16 : 24);
+    pRenderer->SetDepthPrePass(depthPrePass);
+    pRenderer->SetCompactGBuffer(compactGBuffer);
+    pRenderer->SetOcclusionCulling(occlusionCulling);
+    pRenderer->SetTiledLighting(tiledLighting);
+    pRenderer->SetShadowCache(shadowCache);
 
     pRenderer->EndFrame();
-    gui.Render();
+    gui.Render(pRenderer->Stream());
 
     SDL_GL_SwapWindow(pWindow);
     SDL_Delay(10);
 
+    if(++frameCount == traceFrames)
+      ne::Profiler::Instance().WriteChromeTrace(tracePath);
+
     //Handle events
     SDL_Event e;
     while(SDL_PollEvent(&e))
@@ -466,6 +590,11 @@ int main(int argc, char **argv)
           if(e.button.button == SDL_BUTTON_LEFT)
             SDL_SetRelativeMouseMode(SDL_FALSE);
           break;
+
+        case SDL_KEYDOWN:
+          if(e.key.keysym.sym == SDLK_F12 && !e.key.repeat)
+            ne::Profiler::Instance().WriteChromeTrace(tracePath);
+          break;
       }
     }
 